@@ -2,6 +2,30 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <exception>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 //#include <boost/lexical_cast.hpp>
 using namespace std;
 
@@ -37,18 +61,36 @@ struct Journal
 
   void add(const string& entry);
 
+  // puts back an entry which was already numbered (e.g. when loading it from a file)
+  void restore(const char* entry, size_t length);
+
   // persistence is a separate concern, so it should be in a separate class
   void save(const string& filename);
+
+private:
+  // the counter belongs to each journal (a static one would be shared by all the journals)
+  // and the mutex allows several threads to add entries at the same time
+  size_t next_number = 1;
+  mutex entries_mutex;
 };
 
 void Journal::add(const string& entry)
 {
-  static int count = 1;
-  //entries.push_back(boost::lexical_cast<string>(count++)
-  entries.push_back(to_string(count++)
+  lock_guard<mutex> lock{ entries_mutex };
+  //entries.push_back(boost::lexical_cast<string>(next_number++)
+  entries.push_back(to_string(next_number++)
     + ": " + entry);
 }
 
+void Journal::restore(const char* entry, size_t length)
+{
+  lock_guard<mutex> lock{ entries_mutex };
+  entries.emplace_back(entry, length);
+  const size_t number = strtoull(entries.back().c_str(), nullptr, 10);
+  if (number >= next_number)
+    next_number = number + 1;
+}
+
 void Journal::save(const string& filename)
 {
   ofstream ofs(filename);
@@ -60,12 +102,719 @@ struct PersistenceManager
 {
   static void save(const Journal& j, const string& filename)
   {
+    // '\n' instead of endl, endl flushes the file after every entry
     ofstream ofs(filename);
     for (auto& s : j.entries)
-      ofs << s << endl;
+      ofs << s << '\n';
+  }
+};
+
+/*
+* PersistenceManager rewrites the whole file every time we save, which is very slow when the journal is big.
+*
+* AppendOnlyJournalStore is another persistence class: the file is never rewritten, new entries are appended at the end.
+* append only copies the entry to a buffer in memory and returns, and a writer thread takes everything that has been
+* appended so far and writes it with a single system call (group commit). When the writer wakes up it waits up to
+* commit_window for more entries to arrive, so many small appends become one big write.
+*
+* The FsyncPolicy decides when we ask the operating system to really put the data on disk (which is the slow part):
+* - never: we leave it to the operating system, fastest but the last entries can be lost if the machine crashes.
+* - every_commit: after each group of entries written, so an entry is durable once flush returns.
+* - on_close: only when the store is destroyed.
+*
+* flush waits until everything appended before the call has been written (and synced with every_commit).
+* If the writer falls too far behind, append waits, so the memory used by the buffer is limited.
+* If a write or a sync fails, the writer thread keeps the error and the next append or flush throws it in the thread
+* of the caller (an exception escaping the writer thread would end the program). From then on the store is broken:
+* nothing else is written and every append and flush throws.
+*
+* To read the journal back, MappedJournalReader maps the file in memory (mmap/MapViewOfFile) so there is no copy to a
+* stream buffer and no parsing besides finding the end of each line.
+*
+* Entries are stored one per line, so an entry must not contain a new line.
+*/
+enum class FsyncPolicy { never, every_commit, on_close };
+
+// Thin wrapper over the file functions of each operating system
+class AppendFile
+{
+#ifdef _WIN32
+  HANDLE handle;
+#else
+  int fd;
+#endif
+public:
+  explicit AppendFile(const string& filename)
+  {
+#ifdef _WIN32
+    handle = CreateFileA(filename.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+      throw runtime_error("can't open " + filename);
+#else
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+      throw runtime_error("can't open " + filename);
+#endif
+  }
+
+  AppendFile(const AppendFile&) = delete;
+  AppendFile& operator=(const AppendFile&) = delete;
+
+  ~AppendFile()
+  {
+#ifdef _WIN32
+    CloseHandle(handle);
+#else
+    ::close(fd);
+#endif
+  }
+
+  void write(const char* data, size_t size)
+  {
+    while (size > 0)
+    {
+#ifdef _WIN32
+      DWORD written = 0;
+      const DWORD chunk = static_cast<DWORD>(min<size_t>(size, 1u << 30));
+      if (!WriteFile(handle, data, chunk, &written, nullptr))
+        throw runtime_error("can't write the journal");
+#else
+      const ssize_t written = ::write(fd, data, size);
+      if (written < 0)
+        throw runtime_error("can't write the journal");
+#endif
+      data += written;
+      size -= static_cast<size_t>(written);
+    }
+  }
+
+  void sync()
+  {
+#ifdef _WIN32
+    if (!FlushFileBuffers(handle))
+      throw runtime_error("can't sync the journal");
+#else
+    if (::fsync(fd) != 0)
+      throw runtime_error("can't sync the journal");
+#endif
   }
 };
 
+class AppendOnlyJournalStore
+{
+  AppendFile file;
+  FsyncPolicy policy;
+  chrono::microseconds commit_window;
+  size_t max_batch_bytes;
+
+  mutex buffer_mutex;
+  condition_variable data_ready;   // the writer waits for entries
+  condition_variable data_written; // flush and append wait for the writer
+  string pending;                  // appended but not written yet
+  size_t appended_batches = 0;     // number of times pending has been handed to the writer
+  size_t written_batches = 0;
+  size_t commit_count = 0;
+  bool stopping = false;
+  exception_ptr error;             // the first write or sync which failed in the writer
+  thread writer;
+
+public:
+  explicit AppendOnlyJournalStore(const string& filename, FsyncPolicy policy = FsyncPolicy::every_commit,
+    chrono::microseconds commit_window = chrono::microseconds{ 2000 }, size_t max_batch_bytes = 4 << 20)
+    : file{ filename }, policy{ policy }, commit_window{ commit_window }, max_batch_bytes{ max_batch_bytes }
+  {
+    pending.reserve(max_batch_bytes);
+    writer = thread{ &AppendOnlyJournalStore::write_batches, this };
+  }
+
+  ~AppendOnlyJournalStore()
+  {
+    {
+      lock_guard<mutex> lock{ buffer_mutex };
+      stopping = true;
+    }
+    data_ready.notify_one();
+    writer.join();
+    // a destructor can't throw, whoever wanted to know about a failed sync had to call flush
+    if (policy != FsyncPolicy::never && !error)
+    {
+      try
+      {
+        file.sync();
+      }
+      catch (const runtime_error&)
+      {
+      }
+    }
+  }
+
+  void append(const string& entry)
+  {
+    append_lines(entry.data(), entry.size(), true);
+  }
+
+  // Many entries are joined in a local buffer first, so the mutex is taken once per chunk instead of once per entry
+  void append(const vector<string>& entries)
+  {
+    const size_t chunk_bytes = 64 * 1024;
+    string chunk;
+    chunk.reserve(chunk_bytes);
+    for (auto& entry : entries)
+    {
+      chunk += entry;
+      chunk += '\n';
+      if (chunk.size() >= chunk_bytes)
+      {
+        append_lines(chunk.data(), chunk.size(), false);
+        chunk.clear();
+      }
+    }
+    append_lines(chunk.data(), chunk.size(), false);
+  }
+
+  void append(const Journal& journal)
+  {
+    append(journal.entries);
+  }
+
+  // Waits until everything appended before this call is written
+  void flush()
+  {
+    unique_lock<mutex> lock{ buffer_mutex };
+    // the batch the writer may be writing right now, or the next one if there are entries waiting
+    const size_t batch = appended_batches + (pending.empty() ? 0 : 1);
+    data_ready.notify_one();
+    data_written.wait(lock, [&] { return written_batches >= batch; });
+    throw_if_failed();
+  }
+
+  size_t commits()
+  {
+    lock_guard<mutex> lock{ buffer_mutex };
+    return commit_count;
+  }
+
+private:
+  void append_lines(const char* lines, size_t size, bool add_new_line)
+  {
+    if (size == 0 && !add_new_line)
+      return;
+
+    unique_lock<mutex> lock{ buffer_mutex };
+    // back pressure: don't let the buffer grow without limit if the disk is slower than the producers
+    data_written.wait(lock, [&] { return pending.size() < 2 * max_batch_bytes || error; });
+    throw_if_failed();
+    const bool was_empty = pending.empty();
+    pending.append(lines, size);
+    if (add_new_line)
+      pending += '\n';
+    // the first entry starts the commit window of the writer, a full batch ends it early
+    if (was_empty || pending.size() >= max_batch_bytes)
+      data_ready.notify_one();
+  }
+
+  // With buffer_mutex locked
+  void throw_if_failed() const
+  {
+    if (error)
+      rethrow_exception(error);
+  }
+
+  void write_batches()
+  {
+    string writing;
+    writing.reserve(max_batch_bytes);
+
+    unique_lock<mutex> lock{ buffer_mutex };
+    for (;;)
+    {
+      data_ready.wait(lock, [&] { return stopping || !pending.empty(); });
+      if (pending.empty() && stopping)
+        return;
+
+      // group commit: give other appends the chance to join this batch
+      data_ready.wait_for(lock, commit_window, [&] { return stopping || pending.size() >= max_batch_bytes; });
+
+      writing.swap(pending);
+      const size_t batch = ++appended_batches;
+      const bool failed = error != nullptr;
+      lock.unlock();
+      data_written.notify_all(); // appends waiting for space can continue
+
+      exception_ptr failure;
+      if (!failed) // after an error the batches are dropped, the callers get the error instead
+      {
+        try
+        {
+          file.write(writing.data(), writing.size());
+          if (policy == FsyncPolicy::every_commit)
+            file.sync();
+        }
+        catch (...)
+        {
+          failure = current_exception();
+        }
+      }
+      writing.clear();
+
+      lock.lock();
+      if (failure)
+        error = failure;
+      written_batches = batch;
+      ++commit_count;
+      data_written.notify_all();
+    }
+  }
+};
+
+class MappedJournalReader
+{
+  const char* data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  HANDLE file_handle = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+
+public:
+  explicit MappedJournalReader(const string& filename)
+  {
+#ifdef _WIN32
+    file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+      throw runtime_error("can't open " + filename);
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size))
+    {
+      unmap();
+      throw runtime_error("can't get the size of " + filename);
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+    if (size == 0)
+      return;
+    mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+      data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+    {
+      unmap();
+      throw runtime_error("can't map " + filename);
+    }
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw runtime_error("can't open " + filename);
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throw runtime_error("can't get the size of " + filename);
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (size > 0)
+    {
+      void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED)
+      {
+        ::close(fd);
+        throw runtime_error("can't map " + filename);
+      }
+      madvise(mapped, size, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(mapped);
+    }
+    ::close(fd); // the mapping keeps the file alive
+#endif
+  }
+
+  MappedJournalReader(const MappedJournalReader&) = delete;
+  MappedJournalReader& operator=(const MappedJournalReader&) = delete;
+
+  ~MappedJournalReader()
+  {
+    unmap();
+  }
+
+  // Calls f(begin, length) for every entry, the pointers are valid while the reader is alive
+  template <typename F> void for_each_entry(F&& f) const
+  {
+    const char* current = data;
+    const char* end = data + size;
+    while (current < end)
+    {
+      auto line_end = static_cast<const char*>(memchr(current, '\n', end - current));
+      if (!line_end)
+        line_end = end;
+      f(current, static_cast<size_t>(line_end - current));
+      current = line_end + 1;
+    }
+  }
+
+  void load(Journal& journal) const
+  {
+    size_t count = 0;
+    for_each_entry([&](const char*, size_t) { ++count; });
+    journal.entries.reserve(journal.entries.size() + count);
+    for_each_entry([&](const char* entry, size_t length) { journal.restore(entry, length); });
+  }
+
+private:
+  void unmap()
+  {
+#ifdef _WIN32
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file_handle != INVALID_HANDLE_VALUE)
+      CloseHandle(file_handle);
+#else
+    if (data)
+      munmap(const_cast<char*>(data), size);
+#endif
+  }
+};
+
+/*
+* Looking for the entries which contain some words means reading every entry of the journal. JournalIndex is an inverted
+* index: for each term (a word in lower case) it keeps the sorted list of the entries which contain it (the posting list),
+* so a query only reads the posting lists of its terms:
+* - all_of: the entries with all the terms, intersecting the lists starting with the shortest one.
+* - any_of: the entries with any of the terms, merging the lists.
+* - with_prefix: the entries with a term starting with the prefix. The terms are kept sorted (map), so all the terms with
+*   the same prefix are together.
+*
+* Following the SRP, the Journal doesn't know about the index. The index keeps a reference to the journal and remembers
+* how many entries it has already indexed, so before each query it only indexes the entries added since the last one.
+* The index must not be used while other threads are adding entries.
+*
+* save and load write/read the index in a binary file next to the journal file (same name plus ".idx"), so when the
+* journal is loaded again we don't have to index all the entries, only the ones added after the index was saved.
+* The file starts with a header: the number of entries indexed, their size in bytes and a hash of their text. load
+* checks it against the entries of the journal (hashing them is much cheaper than indexing them again), and every entry
+* id of the posting lists, so an old .idx file or the one of another journal is rejected instead of being trusted.
+* The numbers at the beginning of the entries ("1: ") are not indexed.
+*/
+class JournalIndex
+{
+public:
+  typedef uint32_t EntryId; // position of the entry in Journal::entries
+
+  explicit JournalIndex(const Journal& journal) : journal{ journal } {}
+
+  static string filename_for(const string& journal_filename) { return journal_filename + ".idx"; }
+
+  // Indexes the entries added to the journal since the last call
+  void sync()
+  {
+    string term;
+    for (; indexed_count < journal.entries.size(); ++indexed_count)
+    {
+      const auto id = static_cast<EntryId>(indexed_count);
+      for_each_term(journal.entries[indexed_count], term, [&](const string& t) {
+        auto& posting = postings[t];
+        if (posting.empty() || posting.back() != id) // a term repeated in the same entry
+          posting.push_back(id);
+      });
+    }
+  }
+
+  vector<EntryId> all_of(const vector<string>& terms)
+  {
+    sync();
+    vector<const vector<EntryId>*> lists;
+    for (auto& term : terms)
+    {
+      auto it = postings.find(lower_case(term));
+      if (it == postings.end())
+        return {};
+      lists.push_back(&it->second);
+    }
+    if (lists.empty())
+      return {};
+
+    sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+    vector<EntryId> result = *lists[0], next;
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i)
+    {
+      next.clear();
+      set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), back_inserter(next));
+      result.swap(next);
+    }
+    return result;
+  }
+
+  vector<EntryId> any_of(const vector<string>& terms)
+  {
+    sync();
+    vector<const vector<EntryId>*> lists;
+    for (auto& term : terms)
+    {
+      auto it = postings.find(lower_case(term));
+      if (it != postings.end())
+        lists.push_back(&it->second);
+    }
+    return merge(lists);
+  }
+
+  vector<EntryId> with_prefix(const string& prefix)
+  {
+    sync();
+    const string lower = lower_case(prefix);
+    vector<const vector<EntryId>*> lists;
+    for (auto it = postings.lower_bound(lower); it != postings.end() && it->first.compare(0, lower.size(), lower) == 0; ++it)
+      lists.push_back(&it->second);
+    return merge(lists);
+  }
+
+  void save(const string& filename)
+  {
+    sync();
+    string buffer;
+    put(buffer, magic);
+    const Fingerprint fingerprint = fingerprint_of(indexed_count);
+    put(buffer, static_cast<uint64_t>(indexed_count));
+    put(buffer, fingerprint.bytes);
+    put(buffer, fingerprint.hash);
+    put(buffer, static_cast<uint64_t>(postings.size()));
+    for (auto& posting : postings)
+    {
+      put(buffer, static_cast<uint32_t>(posting.first.size()));
+      buffer += posting.first;
+      put(buffer, static_cast<uint64_t>(posting.second.size()));
+      buffer.append(reinterpret_cast<const char*>(posting.second.data()), posting.second.size() * sizeof(EntryId));
+    }
+    ofstream ofs(filename, ios::binary);
+    ofs.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+  }
+
+  // Returns false (and leaves the index empty) if the file doesn't exist or doesn't belong to this journal
+  bool load(const string& filename)
+  {
+    postings.clear();
+    indexed_count = 0;
+
+    ifstream ifs(filename, ios::binary);
+    if (!ifs)
+      return false;
+    const string buffer{ istreambuf_iterator<char>(ifs), istreambuf_iterator<char>() };
+
+    size_t offset = 0;
+    uint32_t file_magic = 0;
+    uint64_t count = 0, terms = 0;
+    Fingerprint fingerprint;
+    if (!get(buffer, offset, file_magic) || file_magic != magic || !get(buffer, offset, count) ||
+      count > journal.entries.size() || !get(buffer, offset, fingerprint.bytes) || !get(buffer, offset, fingerprint.hash) ||
+      !get(buffer, offset, terms))
+      return false;
+    const Fingerprint expected = fingerprint_of(static_cast<size_t>(count));
+    if (fingerprint.bytes != expected.bytes || fingerprint.hash != expected.hash)
+      return false;
+
+    for (uint64_t i = 0; i < terms; ++i)
+    {
+      uint32_t length = 0;
+      uint64_t size = 0;
+      if (!get(buffer, offset, length) || buffer.size() - offset < length)
+        return fail();
+      string term = buffer.substr(offset, length);
+      offset += length;
+      if (!get(buffer, offset, size) || (buffer.size() - offset) / sizeof(EntryId) < size)
+        return fail();
+      auto& posting = postings[term];
+      posting.resize(static_cast<size_t>(size));
+      memcpy(posting.data(), buffer.data() + offset, posting.size() * sizeof(EntryId));
+      offset += posting.size() * sizeof(EntryId);
+      // sorted, without repetitions and only entries which were indexed
+      for (size_t j = 0; j < posting.size(); ++j)
+        if (posting[j] >= count || (j > 0 && posting[j] <= posting[j - 1]))
+          return fail();
+    }
+    indexed_count = static_cast<size_t>(count);
+    return true;
+  }
+
+  size_t term_count() const { return postings.size(); }
+
+  // Calls f(term) for every term of the text, term is a buffer reused between calls
+  template <typename F> static void for_each_term(const string& text, string& term, F&& f)
+  {
+    const auto numbering = text.find(": ");
+    size_t i = numbering == string::npos ? 0 : numbering + 2;
+    while (i < text.size())
+    {
+      while (i < text.size() && !isalnum(static_cast<unsigned char>(text[i])))
+        ++i;
+      term.clear();
+      while (i < text.size() && isalnum(static_cast<unsigned char>(text[i])))
+        term += static_cast<char>(tolower(static_cast<unsigned char>(text[i++])));
+      if (!term.empty())
+        f(term);
+    }
+  }
+
+private:
+  static constexpr uint32_t magic = 0x3244494a; // "JID2", the first version had no fingerprint
+
+  struct Fingerprint
+  {
+    uint64_t bytes = 0;
+    uint64_t hash = 14695981039346656037ull;
+  };
+
+  // Size and FNV-1a hash of the text of the first count entries
+  Fingerprint fingerprint_of(size_t count) const
+  {
+    Fingerprint fingerprint;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const string& entry = journal.entries[i];
+      fingerprint.bytes += entry.size() + 1;
+      for (char c : entry)
+        fingerprint.hash = (fingerprint.hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+      fingerprint.hash = (fingerprint.hash ^ '\n') * 1099511628211ull;
+    }
+    return fingerprint;
+  }
+
+  const Journal& journal;
+  size_t indexed_count = 0;
+  map<string, vector<EntryId>> postings;
+
+  static string lower_case(string text)
+  {
+    for (auto& c : text)
+      c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return text;
+  }
+
+  static vector<EntryId> merge(const vector<const vector<EntryId>*>& lists)
+  {
+    if (lists.size() == 1)
+      return *lists[0];
+    vector<EntryId> result;
+    for (auto list : lists)
+      result.insert(result.end(), list->begin(), list->end());
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+  }
+
+  template <typename T> static void put(string& buffer, T value)
+  {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T> static bool get(const string& buffer, size_t& offset, T& value)
+  {
+    if (buffer.size() - offset < sizeof(T))
+      return false;
+    memcpy(&value, buffer.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  bool fail()
+  {
+    postings.clear();
+    indexed_count = 0;
+    return false;
+  }
+};
+
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void benchmark_journal_storage(size_t count)
+{
+  Journal journal{ "Benchmark" };
+  for (size_t i = 0; i < count; ++i)
+    journal.add("today I wrote entry number " + to_string(i));
+
+  const double endl_ms = measure_ms([&] { journal.save("journal_endl.txt"); });
+  const double rewrite_ms = measure_ms([&] { PersistenceManager::save(journal, "journal_rewrite.txt"); });
+
+  remove("journal_append.txt");
+  size_t commits = 0;
+  const double append_ms = measure_ms([&] {
+    AppendOnlyJournalStore store{ "journal_append.txt", FsyncPolicy::on_close };
+    store.append(journal);
+    store.flush();
+    commits = store.commits();
+  });
+
+  Journal reloaded{ "Reloaded" };
+  const double reload_ms = measure_ms([&] {
+    MappedJournalReader reader{ "journal_append.txt" };
+    reader.load(reloaded);
+  });
+
+  cout << count << " journal entries\n"
+    << "  Journal::save (endl per entry): " << endl_ms << " ms\n"
+    << "  PersistenceManager::save: " << rewrite_ms << " ms\n"
+    << "  AppendOnlyJournalStore (" << commits << " commits): " << append_ms << " ms\n"
+    << "  MappedJournalReader reload: " << reload_ms << " ms"
+    << (reloaded.entries == journal.entries ? "" : " (MISMATCH!)") << "\n";
+}
+
+void benchmark_journal_index(size_t count)
+{
+  const vector<string> words{ "bug", "cried", "today", "ate", "walked", "dog", "rain", "sun", "coffee", "work",
+    "meeting", "friend", "book", "movie", "dinner", "lunch", "train", "late", "early", "happy", "tired", "beach" };
+
+  Journal journal{ "Benchmark" };
+  mt19937 rng{ 1 };
+  uniform_int_distribution<size_t> word_dist{ 0, words.size() - 1 };
+  for (size_t i = 0; i < count; ++i)
+    journal.add(words[word_dist(rng)] + " " + words[word_dist(rng)] + " " + words[word_dist(rng)] + " " + to_string(i % 1000));
+
+  JournalIndex index{ journal };
+  const double build_ms = measure_ms([&] { index.sync(); });
+
+  // brute force: look at the terms of every entry
+  auto scan = [&](auto matches) {
+    vector<JournalIndex::EntryId> result;
+    string term;
+    for (size_t i = 0; i < journal.entries.size(); ++i)
+    {
+      bool found[2] = { false, false };
+      JournalIndex::for_each_term(journal.entries[i], term, [&](const string& t) { matches(t, found); });
+      if (found[0] && found[1])
+        result.push_back(static_cast<JournalIndex::EntryId>(i));
+    }
+    return result;
+  };
+
+  vector<JournalIndex::EntryId> indexed, scanned;
+  const double index_and_ms = measure_ms([&] { indexed = index.all_of({ "coffee", "rain" }); });
+  const double scan_and_ms = measure_ms([&] {
+    scanned = scan([](const string& t, bool* found) { found[0] |= t == "coffee"; found[1] |= t == "rain"; });
+  });
+  const bool and_ok = indexed == scanned;
+
+  const double index_prefix_ms = measure_ms([&] { indexed = index.with_prefix("be"); });
+  const double scan_prefix_ms = measure_ms([&] {
+    scanned = scan([](const string& t, bool* found) { found[0] |= t.compare(0, 2, "be") == 0; found[1] = found[0]; });
+  });
+  const bool prefix_ok = indexed == scanned;
+
+  const double save_ms = measure_ms([&] { index.save("journal_index.idx"); });
+  JournalIndex reloaded{ journal };
+  const double load_ms = measure_ms([&] { reloaded.load("journal_index.idx"); });
+
+  cout << count << " journal entries, " << index.term_count() << " terms\n"
+    << "  index build: " << build_ms << " ms, save: " << save_ms << " ms, load: " << load_ms << " ms\n"
+    << "  coffee AND rain: index " << index_and_ms << " ms, scan " << scan_and_ms << " ms"
+    << (and_ok ? "" : " (MISMATCH!)") << "\n"
+    << "  prefix be*: index " << index_prefix_ms << " ms, scan " << scan_prefix_ms << " ms"
+    << (prefix_ok && reloaded.with_prefix("be") == indexed ? "" : " (MISMATCH!)") << "\n";
+}
+
 void main()
 {
   Journal journal{"Dear Diary"};
@@ -78,4 +827,45 @@ void main()
 
   //PersistenceManager pm;
   //pm.save(journal, "diary.txt");
+
+  // append only: the entries are added at the end of the file by the writer thread of the store
+  {
+    remove("diary_log.txt");
+    remove(JournalIndex::filename_for("diary_log.txt").c_str());
+    AppendOnlyJournalStore store{ "diary_log.txt" };
+    store.append(journal);
+    journal.add("I wrote my diary in an append only file");
+    store.append(journal.entries.back());
+    store.flush();
+  }
+
+  Journal reloaded{ "Dear Diary" };
+  MappedJournalReader{ "diary_log.txt" }.load(reloaded);
+  reloaded.add("I read my diary again");
+  for (auto& entry : reloaded.entries)
+    cout << entry << "\n";
+
+  // the index finds the entries with some words without reading all of them
+  JournalIndex index{ reloaded };
+  for (auto id : index.all_of({ "diary", "again" }))
+    cout << "found: " << reloaded.entries[id] << "\n";
+  for (auto id : index.with_prefix("cr"))
+    cout << "found: " << reloaded.entries[id] << "\n";
+  index.save(JournalIndex::filename_for("diary_log.txt"));
+
+  // loading the saved index, only the entries added after saving it are indexed again
+  reloaded.add("I cried again when I read it");
+  JournalIndex loaded{ reloaded };
+  cout << "index loaded: " << loaded.load(JournalIndex::filename_for("diary_log.txt")) << "\n";
+  for (auto id : loaded.all_of({ "cried", "again" }))
+    cout << "found: " << reloaded.entries[id] << "\n";
+
+  // the index of another journal is rejected
+  JournalIndex foreign{ journal };
+  cout << "index of another journal loaded: " << foreign.load(JournalIndex::filename_for("diary_log.txt")) << "\n";
+
+  benchmark_journal_storage(1'000'000);
+  benchmark_journal_index(1'000'000);
+  // 10M entries need around 1GB for the journal in memory
+  //benchmark_journal_storage(10'000'000);
 }
\ No newline at end of file
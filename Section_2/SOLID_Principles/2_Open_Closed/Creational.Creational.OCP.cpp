@@ -5,6 +5,21 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <iterator>
+#include <algorithm>
+#include <thread>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <exception>
+#include <system_error>
+#include <type_traits>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 using namespace std;
 
 enum class Color { red, green, blue };
@@ -149,6 +164,1003 @@ template <typename T> AndSpecification<T> operator&&
 
 // new:
 
+/*
+* BetterFilter is closed for modification, but it has to call the virtual is_satisfied once per product on every query, so
+* with a very big catalog the linear scan is the bottleneck.
+*
+* ProductCatalog keeps the products and, for each possible Color and Size, a bitmap with one bit per product (bit i set means
+* product i has that color/size). When a query arrives, the specification is translated into bitmaps:
+* - ColorSpecification and SizeSpecification are just the bitmap of their value.
+* - AndSpecification is the intersection of both bitmaps, done 64 products at a time with a single &.
+*
+* Specifications the catalog does not know (any new one we create later) still work, because the catalog falls back to
+* is_satisfied, but only for the products which are still candidates after intersecting the known bitmaps. This way
+* we keep the OCP: Specification and Filter are not modified, and new specifications don't need to touch the catalog.
+*/
+inline size_t count_trailing_zeros(uint64_t word)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+    return index;
+  _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+  return index + 32;
+#else
+  return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+/*
+* Many times the same filters are run again and again while the catalog barely changes. A MaterializedView keeps the result
+* of a specification and the catalog updates it every time a product is added, updated or removed, so reading the view
+* costs only the size of the result instead of filtering the whole catalog again.
+*
+* The views are created with ProductCatalog::materialize, which fills them once from the bitmaps, and they are owned by
+* the catalog. When a product changes, each view only checks that product with is_satisfied: if it matches now and it
+* was not in the view it is appended, and if it doesn't match any more it is removed by moving the last match to its
+* place, so the matches of a view are not kept in insertion order.
+* As with AndSpecification, the specification of a view must outlive the view. Products must be modified through
+* ProductCatalog::update, otherwise neither the bitmaps nor the views know about the change.
+*/
+class MaterializedView
+{
+  friend struct ProductCatalog;
+
+  const Specification<Product>& spec;
+  vector<Product*> matches;
+  unordered_map<const Product*, size_t> position; // index of each match in matches
+
+  explicit MaterializedView(const Specification<Product>& spec) : spec{ spec } {}
+
+  void insert(Product* product)
+  {
+    position[product] = matches.size();
+    matches.push_back(product);
+  }
+
+  void erase(const Product* product)
+  {
+    auto it = position.find(product);
+    if (it == position.end())
+      return;
+
+    const size_t index = it->second;
+    position.erase(it);
+    if (index != matches.size() - 1)
+    {
+      matches[index] = matches.back();
+      position[matches[index]] = index;
+    }
+    matches.pop_back();
+  }
+
+  void changed(Product* product)
+  {
+    const bool satisfied = spec.is_satisfied(product);
+    const bool contained = position.count(product) != 0;
+    if (satisfied && !contained)
+      insert(product);
+    else if (!satisfied && contained)
+      erase(product);
+  }
+
+public:
+  const vector<Product*>& items() const { return matches; }
+  size_t size() const { return matches.size(); }
+};
+
+struct ProductCatalog
+{
+  typedef vector<uint64_t> Bitmap;
+
+  static constexpr size_t color_count = static_cast<size_t>(Color::blue) + 1;
+  static constexpr size_t size_count = static_cast<size_t>(Size::large) + 1;
+
+  void reserve(size_t count)
+  {
+    products.reserve(count);
+    for (auto& bitmap : by_color)
+      bitmap.reserve(words_for(count));
+    for (auto& bitmap : by_size)
+      bitmap.reserve(words_for(count));
+  }
+
+  // Returns false (and does nothing) if the product is already in the catalog, otherwise it would be indexed twice
+  bool add(Product* product)
+  {
+    if (index_of.count(product))
+      return false;
+
+    const size_t index = products.size();
+    products.push_back(product);
+
+    if (index % 64 == 0)
+    {
+      for (auto& bitmap : by_color)
+        bitmap.push_back(0);
+      for (auto& bitmap : by_size)
+        bitmap.push_back(0);
+    }
+
+    set_bit(by_color[static_cast<size_t>(product->color)], index);
+    set_bit(by_size[static_cast<size_t>(product->size)], index);
+    index_of[product] = index;
+
+    for (auto& view : views)
+      view->changed(product);
+    return true;
+  }
+
+  // Applies change to the product and updates the bitmaps and the views
+  template <typename F> void update(Product* product, F&& change)
+  {
+    const size_t index = index_of.at(product);
+    clear_bit(by_color[static_cast<size_t>(product->color)], index);
+    clear_bit(by_size[static_cast<size_t>(product->size)], index);
+
+    change(*product);
+
+    set_bit(by_color[static_cast<size_t>(product->color)], index);
+    set_bit(by_size[static_cast<size_t>(product->size)], index);
+
+    for (auto& view : views)
+      view->changed(product);
+  }
+
+  void remove(Product* product)
+  {
+    auto it = index_of.find(product);
+    if (it == index_of.end())
+      return;
+
+    const size_t index = it->second;
+    index_of.erase(it);
+    // the slot is kept empty: with no bits set it never matches a query
+    clear_bit(by_color[static_cast<size_t>(product->color)], index);
+    clear_bit(by_size[static_cast<size_t>(product->size)], index);
+    products[index] = nullptr;
+
+    for (auto& view : views)
+      view->erase(product);
+  }
+
+  MaterializedView& materialize(const Specification<Product>& spec)
+  {
+    views.emplace_back(new MaterializedView{ spec });
+    auto& view = *views.back();
+    for (auto p : filter(spec))
+      view.insert(p);
+    return view;
+  }
+
+  void drop(const MaterializedView& view)
+  {
+    views.erase(remove_if(views.begin(), views.end(),
+      [&](const unique_ptr<MaterializedView>& v) { return v.get() == &view; }), views.end());
+  }
+
+  size_t size() const { return index_of.size(); }
+
+  vector<Product*> filter(const Specification<Product>& spec) const
+  {
+    vector<Product*> result;
+    Bitmap matches;
+    if (!evaluate(spec, matches))
+    {
+      // nothing we can index, so it is the same scan as BetterFilter
+      for (auto p : products)
+        if (p && spec.is_satisfied(p))
+          result.push_back(p);
+      return result;
+    }
+
+    for (size_t w = 0; w < matches.size(); ++w)
+    {
+      uint64_t word = matches[w];
+      while (word)
+      {
+        result.push_back(products[w * 64 + count_trailing_zeros(word)]);
+        word &= word - 1; // clear lowest set bit
+      }
+    }
+    return result;
+  }
+
+private:
+  vector<Product*> products; // removed products leave a nullptr
+  unordered_map<const Product*, size_t> index_of;
+  Bitmap by_color[color_count];
+  Bitmap by_size[size_count];
+  vector<unique_ptr<MaterializedView>> views;
+
+  static size_t words_for(size_t count) { return (count + 63) / 64; }
+
+  static void set_bit(Bitmap& bitmap, size_t index)
+  {
+    bitmap[index / 64] |= uint64_t{ 1 } << (index % 64);
+  }
+
+  static void clear_bit(Bitmap& bitmap, size_t index)
+  {
+    bitmap[index / 64] &= ~(uint64_t{ 1 } << (index % 64));
+  }
+
+  // Returns false if the specification can not be answered from the bitmaps
+  bool evaluate(const Specification<Product>& spec, Bitmap& out) const
+  {
+    if (auto color = dynamic_cast<const ColorSpecification*>(&spec))
+    {
+      out = by_color[static_cast<size_t>(color->color)];
+      return true;
+    }
+
+    if (auto size = dynamic_cast<const SizeSpecification*>(&spec))
+    {
+      out = by_size[static_cast<size_t>(size->size)];
+      return true;
+    }
+
+    if (auto both = dynamic_cast<const AndSpecification<Product>*>(&spec))
+    {
+      Bitmap other;
+      const bool has_first = evaluate(both->first, out);
+      const bool has_second = evaluate(both->second, has_first ? other : out);
+
+      if (has_first && has_second)
+      {
+        for (size_t w = 0; w < out.size(); ++w)
+          out[w] &= other[w];
+      }
+      else if (has_first)
+        refine(out, both->second);
+      else if (has_second)
+        refine(out, both->first);
+
+      return has_first || has_second;
+    }
+
+    return false;
+  }
+
+  // Clears the candidates which do not satisfy spec, calling is_satisfied only on the bits still set
+  void refine(Bitmap& candidates, const Specification<Product>& spec) const
+  {
+    for (size_t w = 0; w < candidates.size(); ++w)
+    {
+      uint64_t word = candidates[w];
+      while (word)
+      {
+        const uint64_t lowest = word & (~word + 1);
+        const size_t index = w * 64 + count_trailing_zeros(word);
+        if (!spec.is_satisfied(products[index]))
+          candidates[w] &= ~lowest;
+        word &= word - 1;
+      }
+    }
+  }
+};
+
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Products with random color and size (and no name, to keep the memory low) for the benchmarks
+vector<Product> make_random_products(size_t count, unsigned seed)
+{
+  mt19937 rng{ seed };
+  uniform_int_distribution<int> color_dist{ 0, static_cast<int>(ProductCatalog::color_count) - 1 };
+  uniform_int_distribution<int> size_dist{ 0, static_cast<int>(ProductCatalog::size_count) - 1 };
+
+  vector<Product> products;
+  products.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+    products.push_back(Product{ "", static_cast<Color>(color_dist(rng)), static_cast<Size>(size_dist(rng)) });
+  return products;
+}
+
+vector<Product*> pointers_to(vector<Product>& products)
+{
+  vector<Product*> result;
+  result.reserve(products.size());
+  for (auto& p : products)
+    result.push_back(&p);
+  return result;
+}
+
+void benchmark_catalog(size_t count)
+{
+  auto products = make_random_products(count, 42);
+
+  auto all = pointers_to(products);
+  ProductCatalog catalog;
+  catalog.reserve(count);
+  for (auto p : all)
+    catalog.add(p);
+
+  ColorSpecification green(Color::green);
+  SizeSpecification large(Size::large);
+  auto spec = green && large;
+
+  BetterFilter bf;
+  vector<Product*> scanned, indexed;
+  const double scan_ms = measure_ms([&] { scanned = bf.filter(all, spec); });
+  const double index_ms = measure_ms([&] { indexed = catalog.filter(spec); });
+
+  cout << count << " products, green && large -> " << indexed.size() << " matches\n"
+    << "  BetterFilter scan: " << scan_ms << " ms\n"
+    << "  ProductCatalog bitmaps: " << index_ms << " ms"
+    << (scanned == indexed ? "" : " (MISMATCH!)") << "\n";
+}
+
+/*
+* Another option when the specifications are known at compile time is to not use virtual functions at all.
+*
+* StaticSpecification uses the CRTP (the derived class is the template argument) so operator&&, operator|| and operator!
+* only accept our static specifications and return a new type which contains both operands (expression templates).
+* This way, green && large is a StaticAndSpecification<StaticColorSpecification, StaticSizeSpecification>, and when
+* StaticFilter calls it the compiler sees the whole expression and inlines it into a single predicate, without virtual calls.
+*
+* The composed specifications store copies of the operands (they are very small), so the problem with temporaries we have
+* with AndSpecification (see the warning in main) does not happen here.
+*
+* The combinations use & and | instead of && and || on purpose: they evaluate both sides, but there is no branch, so the first
+* loop in StaticFilter only writes 0 or 1 per product. Over a vector<Product> that loop is NOT vectorized: Product has a string
+* inside, so the colors are 40 bytes apart and the compilers don't vectorize such strided loads. What we gain there is a loop
+* with no calls and no branches. The second loop collects the matches.
+* The work is done in blocks so the temporary flags stay in the cache and there is no allocation per query.
+*
+* To really vectorize it the data must be stored by columns: ProductColumns keeps the colors in one array and the sizes in
+* another, one byte each, so 16 products are compared with a single SSE2 instruction. The static specifications can be
+* evaluated on a row of ProductColumns too, and that loop is vectorized (checked with GCC -O3 -fopt-info-vec). The result
+* are the indexes of the matching rows.
+*/
+struct ProductColumns
+{
+  vector<uint8_t> colors;
+  vector<uint8_t> sizes;
+
+  explicit ProductColumns(const vector<Product>& products)
+  {
+    colors.reserve(products.size());
+    sizes.reserve(products.size());
+    for (auto& p : products)
+    {
+      colors.push_back(static_cast<uint8_t>(p.color));
+      sizes.push_back(static_cast<uint8_t>(p.size));
+    }
+  }
+
+  size_t size() const { return colors.size(); }
+};
+
+template <typename Derived> struct StaticSpecification
+{
+  const Derived& self() const { return static_cast<const Derived&>(*this); }
+};
+
+struct StaticColorSpecification : StaticSpecification<StaticColorSpecification>
+{
+  Color color;
+
+  explicit StaticColorSpecification(const Color color) : color{ color } {}
+
+  bool operator()(const Product& item) const { return item.color == color; }
+  bool operator()(const ProductColumns& columns, size_t row) const { return columns.colors[row] == static_cast<uint8_t>(color); }
+};
+
+struct StaticSizeSpecification : StaticSpecification<StaticSizeSpecification>
+{
+  Size size;
+
+  explicit StaticSizeSpecification(const Size size) : size{ size } {}
+
+  bool operator()(const Product& item) const { return item.size == size; }
+  bool operator()(const ProductColumns& columns, size_t row) const { return columns.sizes[row] == static_cast<uint8_t>(size); }
+};
+
+template <typename L, typename R> struct StaticAndSpecification : StaticSpecification<StaticAndSpecification<L, R>>
+{
+  L first;
+  R second;
+
+  StaticAndSpecification(const L& first, const R& second) : first{ first }, second{ second } {}
+
+  template <typename... Item> bool operator()(const Item&... item) const { return first(item...) & second(item...); }
+};
+
+template <typename L, typename R> struct StaticOrSpecification : StaticSpecification<StaticOrSpecification<L, R>>
+{
+  L first;
+  R second;
+
+  StaticOrSpecification(const L& first, const R& second) : first{ first }, second{ second } {}
+
+  template <typename... Item> bool operator()(const Item&... item) const { return first(item...) | second(item...); }
+};
+
+template <typename S> struct StaticNotSpecification : StaticSpecification<StaticNotSpecification<S>>
+{
+  S spec;
+
+  explicit StaticNotSpecification(const S& spec) : spec{ spec } {}
+
+  template <typename... Item> bool operator()(const Item&... item) const { return !spec(item...); }
+};
+
+template <typename L, typename R> StaticAndSpecification<L, R> operator&&
+(const StaticSpecification<L>& first, const StaticSpecification<R>& second)
+{
+  return { first.self(), second.self() };
+}
+
+template <typename L, typename R> StaticOrSpecification<L, R> operator||
+(const StaticSpecification<L>& first, const StaticSpecification<R>& second)
+{
+  return { first.self(), second.self() };
+}
+
+template <typename S> StaticNotSpecification<S> operator!(const StaticSpecification<S>& spec)
+{
+  return StaticNotSpecification<S>{ spec.self() };
+}
+
+struct StaticFilter
+{
+  template <typename Spec>
+  vector<const Product*> filter(const vector<Product>& items, const StaticSpecification<Spec>& spec) const
+  {
+    const Spec& predicate = spec.self();
+    const size_t block_size = 4096;
+    uint8_t matches[block_size];
+
+    vector<const Product*> result;
+    for (size_t begin = 0; begin < items.size(); begin += block_size)
+    {
+      const size_t count = min(block_size, items.size() - begin);
+      const Product* block = items.data() + begin;
+
+      for (size_t i = 0; i < count; ++i) // no calls and no branches
+        matches[i] = predicate(block[i]);
+
+      for (size_t i = 0; i < count; ++i)
+        if (matches[i])
+          result.push_back(&items[begin + i]);
+    }
+    return result;
+  }
+
+  // The indexes of the matching rows
+  template <typename Spec>
+  vector<size_t> filter(const ProductColumns& columns, const StaticSpecification<Spec>& spec) const
+  {
+    const Spec& predicate = spec.self();
+    const size_t block_size = 4096;
+    uint8_t matches[block_size];
+
+    vector<size_t> result;
+    for (size_t begin = 0; begin < columns.size(); begin += block_size)
+    {
+      const size_t count = min(block_size, columns.size() - begin);
+
+      for (size_t i = 0; i < count; ++i) // vectorized: contiguous bytes, no calls and no branches
+        matches[i] = predicate(columns, begin + i);
+
+      for (size_t i = 0; i < count; ++i)
+        if (matches[i])
+          result.push_back(begin + i);
+    }
+    return result;
+  }
+
+  template <typename Spec>
+  vector<Product*> filter(const vector<Product*>& items, const StaticSpecification<Spec>& spec) const
+  {
+    const Spec& predicate = spec.self();
+    vector<Product*> result;
+    for (auto p : items)
+      if (predicate(*p))
+        result.push_back(p);
+    return result;
+  }
+};
+
+void benchmark_static_specifications(size_t count)
+{
+  auto products = make_random_products(count, 7);
+  auto all = pointers_to(products);
+
+  ColorSpecification green(Color::green);
+  SizeSpecification large(Size::large);
+  auto virtual_spec = green && large;
+
+  auto static_spec = StaticColorSpecification{ Color::green } && StaticSizeSpecification{ Size::large };
+
+  BetterFilter bf;
+  StaticFilter sf;
+  const ProductColumns columns{ products };
+  vector<Product*> virtual_result;
+  vector<const Product*> static_result;
+  vector<size_t> column_result;
+  const double virtual_ms = measure_ms([&] { virtual_result = bf.filter(all, virtual_spec); });
+  const double static_ms = measure_ms([&] { static_result = sf.filter(products, static_spec); });
+  const double columns_ms = measure_ms([&] { column_result = sf.filter(columns, static_spec); });
+
+  bool same = virtual_result.size() == static_result.size() && virtual_result.size() == column_result.size();
+  for (size_t i = 0; same && i < virtual_result.size(); ++i)
+    same = virtual_result[i] == static_result[i] && virtual_result[i] == &products[column_result[i]];
+
+  cout << count << " products, green && large -> " << static_result.size() << " matches\n"
+    << "  virtual Specification<Product>: " << virtual_ms << " ms\n"
+    << "  StaticSpecification over vector<Product>: " << static_ms << " ms\n"
+    << "  StaticSpecification over ProductColumns: " << columns_ms << " ms"
+    << (same ? "" : " (MISMATCH!)") << "\n";
+}
+
+/*
+* Filter<T>::filter receives the items by value (a copy of the whole vector) and returns a new vector with the results, so
+* with a big catalog every query copies and allocates, and nothing can be done until all the items have been checked.
+*
+* We don't change the Filter interface (OCP), we add two more ways of filtering:
+*
+* - LazyFilter returns a FilteredRange, which only keeps a reference to the items. Its iterator looks for the next match
+*   when it is incremented, so nothing is copied and we can stop as soon as we have the matches we need. The items must
+*   outlive the range. A specification given as a named variable is only referenced (it must outlive the range too), but
+*   a temporary one, like in for (auto p : lf.filter(all, green && large)), is moved into the range, since the temporary
+*   dies before the loop starts.
+*
+* - ParallelFilter implements Filter<T>, but also has an overload taking the items by const reference. It splits the items in
+*   one contiguous chunk per core, every thread filters its own chunk into its own vector and, at the end, the vectors are
+*   concatenated in chunk order, so the result has the same order as BetterFilter. We use our own threads instead of
+*   std::execution because the parallel algorithms need TBB with some compilers. Small inputs are filtered in the calling
+*   thread since starting threads would cost more than the filter itself.
+*   is_satisfied is const, so the specifications can be shared between threads as long as they don't have mutable state.
+*   If is_satisfied throws in a worker, the exception is kept and thrown again by filter once all the threads have finished,
+*   and if a thread can't be started its chunk is filtered by the calling thread.
+*/
+template <typename T> class FilteredRange
+{
+public:
+  class iterator
+  {
+    T* const* current;
+    T* const* last;
+    const Specification<T>* spec;
+
+    void skip_non_matching()
+    {
+      while (current != last && !spec->is_satisfied(*current))
+        ++current;
+    }
+
+  public:
+    typedef forward_iterator_tag iterator_category;
+    typedef T* value_type;
+    typedef ptrdiff_t difference_type;
+    typedef T* const* pointer;
+    typedef T* const& reference;
+
+    iterator(T* const* current, T* const* last, const Specification<T>* spec)
+      : current{ current }, last{ last }, spec{ spec }
+    {
+      skip_non_matching();
+    }
+
+    reference operator*() const { return *current; }
+
+    iterator& operator++()
+    {
+      ++current;
+      skip_non_matching();
+      return *this;
+    }
+
+    iterator operator++(int)
+    {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const iterator& other) const { return current == other.current; }
+    bool operator!=(const iterator& other) const { return current != other.current; }
+  };
+
+  // spec may own the specification (a temporary moved into the range) or not (a null deleter)
+  FilteredRange(const vector<T*>& items, shared_ptr<const Specification<T>> spec)
+    : first{ items.data() }, last{ items.data() + items.size() }, spec{ move(spec) }
+  {
+  }
+
+  iterator begin() const { return { first, last, spec.get() }; }
+  iterator end() const { return { last, last, spec.get() }; }
+
+private:
+  T* const* first;
+  T* const* last;
+  shared_ptr<const Specification<T>> spec;
+};
+
+template <typename T> struct LazyFilter
+{
+  FilteredRange<T> filter(const vector<T*>& items, const Specification<T>& spec) const
+  {
+    return { items, shared_ptr<const Specification<T>>{ &spec, [](const Specification<T>*) {} } };
+  }
+
+  // A temporary specification is kept alive by the range
+  template <typename Spec, typename = enable_if_t<!is_lvalue_reference<Spec>::value &&
+    is_base_of<Specification<T>, Spec>::value>>
+  FilteredRange<T> filter(const vector<T*>& items, Spec&& spec) const
+  {
+    return { items, make_shared<const Spec>(move(spec)) };
+  }
+};
+
+template <typename T> struct ParallelFilter : Filter<T>
+{
+  size_t thread_count;
+  size_t min_items_per_thread;
+
+  explicit ParallelFilter(size_t thread_count = thread::hardware_concurrency(), size_t min_items_per_thread = 64 * 1024)
+    : thread_count{ max<size_t>(thread_count, 1) }, min_items_per_thread{ max<size_t>(min_items_per_thread, 1) }
+  {
+  }
+
+  vector<T*> filter(vector<T*> items, Specification<T>& spec) override
+  {
+    return filter(static_cast<const vector<T*>&>(items), static_cast<const Specification<T>&>(spec));
+  }
+
+  vector<T*> filter(const vector<T*>& items, const Specification<T>& spec) const
+  {
+    const size_t chunks = min(thread_count, max<size_t>(items.size() / min_items_per_thread, 1));
+    const size_t chunk_size = (items.size() + chunks - 1) / chunks;
+
+    vector<vector<T*>> partial(chunks);
+    vector<exception_ptr> errors(chunks);
+    auto filter_chunk = [&](size_t chunk)
+    {
+      try
+      {
+        const size_t begin = chunk * chunk_size;
+        const size_t end = min(begin + chunk_size, items.size());
+        for (size_t i = begin; i < end; ++i)
+          if (spec.is_satisfied(items[i]))
+            partial[chunk].push_back(items[i]);
+      }
+      catch (...)
+      {
+        errors[chunk] = current_exception(); // an exception escaping a thread would end the program
+      }
+    };
+
+    vector<thread> workers;
+    workers.reserve(chunks - 1);
+    size_t started = 1;
+    try
+    {
+      for (; started < chunks; ++started)
+        workers.emplace_back(filter_chunk, started);
+    }
+    catch (const system_error&)
+    {
+      // no more threads available, the rest of the chunks are done below
+    }
+    filter_chunk(0); // the calling thread does the first chunk
+    for (size_t chunk = started; chunk < chunks; ++chunk)
+      filter_chunk(chunk);
+    for (auto& worker : workers)
+      worker.join();
+    for (auto& error : errors)
+      if (error)
+        rethrow_exception(error);
+
+    if (chunks == 1)
+      return move(partial[0]);
+
+    size_t total = 0;
+    for (auto& part : partial)
+      total += part.size();
+
+    vector<T*> result;
+    result.reserve(total);
+    for (auto& part : partial)
+      result.insert(result.end(), part.begin(), part.end());
+    return result;
+  }
+};
+
+void benchmark_parallel_filter(size_t count)
+{
+  auto products = make_random_products(count, 3);
+  auto all = pointers_to(products);
+
+  ColorSpecification green(Color::green);
+  SizeSpecification large(Size::large);
+  auto spec = green && large;
+
+  BetterFilter bf;
+  LazyFilter<Product> lf;
+  ParallelFilter<Product> pf;
+
+  vector<Product*> serial, parallel;
+  size_t lazy_count = 0;
+  const double serial_ms = measure_ms([&] { serial = bf.filter(all, spec); });
+  const double lazy_ms = measure_ms([&] { for (auto p : lf.filter(all, spec)) { (void)p; ++lazy_count; } });
+  const double parallel_ms = measure_ms([&] { parallel = pf.filter(all, spec); });
+
+  cout << count << " products, green && large -> " << parallel.size() << " matches\n"
+    << "  BetterFilter: " << serial_ms << " ms\n"
+    << "  LazyFilter (counting, no copies): " << lazy_ms << " ms\n"
+    << "  ParallelFilter (" << pf.thread_count << " threads): " << parallel_ms << " ms"
+    << (serial == parallel && lazy_count == serial.size() ? "" : " (MISMATCH!)") << "\n";
+}
+
+/*
+* With AndSpecification the predicates are always evaluated in the order the user wrote them. If the first one is expensive
+* or almost every product satisfies it, we pay for it on every item.
+*
+* QueryPlanner takes a sample of the items and, for each predicate, measures the hit ratio (how many sampled items satisfy it)
+* and the average cost of one evaluation. All the predicates are run once over the sample before timing them, so the first
+* one doesn't pay for bringing the sample into the cache, and then they are timed in several rounds, one predicate after
+* another in each round, keeping the fastest round of each one. With that it orders the predicates:
+* - For a conjunction (all_of) we want to reject the item as soon as possible, so we sort by cost / (1 - hit ratio):
+*   cheap predicates which reject many items go first.
+* - For a disjunction (any_of) we want to accept the item as soon as possible, so we sort by cost / hit ratio.
+*
+* The result is a PlannedSpecification, which is a Specification<T> itself, so it can be used with BetterFilter or any other
+* filter. It evaluates the predicates in the planned order with short-circuit and counts, for each one, how many times it has
+* been evaluated and how many times it was satisfied. explain prints the plan with the sampled statistics and the counters,
+* so we can see why a filter was fast or slow. The counters are not atomic, so don't use a plan from several threads at once.
+*
+* A chain of AndSpecification (a && b && c) can also be given to plan, which flattens it into a conjunction. The names of the
+* predicates, used by explain, are given in the same order (a Specification has no name); the ones missing are called
+* "predicate 1", "predicate 2"...
+*/
+template <typename T> struct NamedSpecification
+{
+  string name;
+  const Specification<T>& spec;
+};
+
+enum class PlanKind { all_of, any_of };
+
+template <typename T> struct PlanStep
+{
+  string name;
+  const Specification<T>* spec;
+  double sampled_hit_ratio;
+  double sampled_cost_ns;
+  mutable size_t evaluations = 0;
+  mutable size_t hits = 0;
+};
+
+template <typename T> struct PlannedSpecification : Specification<T>
+{
+  PlanKind kind;
+  size_t sample_size;
+  vector<PlanStep<T>> steps; // in evaluation order
+
+  bool is_satisfied(T* item) const override
+  {
+    const bool short_circuit_on = kind == PlanKind::any_of;
+    for (auto& step : steps)
+    {
+      ++step.evaluations;
+      const bool satisfied = step.spec->is_satisfied(item);
+      if (satisfied)
+        ++step.hits;
+      if (satisfied == short_circuit_on)
+        return short_circuit_on;
+    }
+    return !short_circuit_on;
+  }
+
+  void reset_counters()
+  {
+    for (auto& step : steps)
+      step.evaluations = step.hits = 0;
+  }
+
+  void explain(ostream& os) const
+  {
+    os << (kind == PlanKind::all_of ? "all_of" : "any_of") << " plan (sampled " << sample_size << " items):\n";
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+      auto& step = steps[i];
+      os << "  " << i + 1 << ". " << step.name
+        << ": sampled hit ratio " << step.sampled_hit_ratio
+        << ", sampled cost " << step.sampled_cost_ns << " ns"
+        << " | evaluated " << step.evaluations << ", satisfied " << step.hits << "\n";
+    }
+  }
+};
+
+template <typename T> class QueryPlanner
+{
+  vector<T*> sample;
+
+public:
+  // Takes sample_size items evenly spread over the items
+  explicit QueryPlanner(const vector<T*>& items, size_t sample_size = 1000)
+  {
+    const size_t step = max<size_t>(items.size() / max<size_t>(sample_size, 1), 1);
+    for (size_t i = 0; i < items.size() && sample.size() < sample_size; i += step)
+      sample.push_back(items[i]);
+  }
+
+  PlannedSpecification<T> all_of(const vector<NamedSpecification<T>>& specs) const
+  {
+    return make_plan(PlanKind::all_of, specs);
+  }
+
+  PlannedSpecification<T> any_of(const vector<NamedSpecification<T>>& specs) const
+  {
+    return make_plan(PlanKind::any_of, specs);
+  }
+
+  // Flattens a chain of AndSpecification into a conjunction, names are given to the predicates from left to right
+  PlannedSpecification<T> plan(const Specification<T>& spec, const vector<string>& names = {}) const
+  {
+    vector<NamedSpecification<T>> specs;
+    flatten(spec, names, specs);
+    return all_of(specs);
+  }
+
+private:
+  static const size_t timing_rounds = 5;
+
+  static void flatten(const Specification<T>& spec, const vector<string>& names, vector<NamedSpecification<T>>& specs)
+  {
+    if (auto both = dynamic_cast<const AndSpecification<T>*>(&spec))
+    {
+      flatten(both->first, names, specs);
+      flatten(both->second, names, specs);
+    }
+    else
+    {
+      const size_t i = specs.size();
+      specs.push_back({ i < names.size() ? names[i] : "predicate " + to_string(i + 1), spec });
+    }
+  }
+
+  PlannedSpecification<T> make_plan(PlanKind kind, const vector<NamedSpecification<T>>& specs) const
+  {
+    PlannedSpecification<T> result;
+    result.kind = kind;
+    result.sample_size = sample.size();
+
+    // warm up: every predicate once over the sample, which also counts the hits
+    vector<size_t> hits(specs.size(), 0);
+    for (size_t i = 0; i < specs.size(); ++i)
+      for (auto item : sample)
+        hits[i] += specs[i].spec.is_satisfied(item);
+
+    // interleaved rounds, the fastest one of each predicate is its cost
+    vector<double> best_ms(specs.size(), numeric_limits<double>::infinity());
+    volatile size_t sink = 0; // so the timed loops are not optimized away
+    for (size_t round = 0; round < timing_rounds; ++round)
+      for (size_t i = 0; i < specs.size(); ++i)
+        best_ms[i] = min(best_ms[i], measure_ms([&] {
+          size_t round_hits = 0;
+          for (auto item : sample)
+            round_hits += specs[i].spec.is_satisfied(item);
+          sink = round_hits;
+        }));
+
+    vector<double> rank;
+    for (size_t i = 0; i < specs.size(); ++i)
+    {
+      auto& named = specs[i];
+      const double count = static_cast<double>(max<size_t>(sample.size(), 1));
+      const double hit_ratio = hits[i] / count;
+      const double cost_ns = best_ms[i] * 1e6 / count;
+      result.steps.push_back(PlanStep<T>{ named.name, &named.spec, hit_ratio, cost_ns });
+
+      // expected cost to decide the item, a predicate which never decides goes last
+      const double decides = kind == PlanKind::all_of ? 1.0 - hit_ratio : hit_ratio;
+      rank.push_back(decides > 0 ? cost_ns / decides : numeric_limits<double>::infinity());
+    }
+
+    vector<size_t> order(specs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rank[a] < rank[b]; });
+
+    vector<PlanStep<T>> ordered;
+    for (auto i : order)
+      ordered.push_back(result.steps[i]);
+    result.steps = move(ordered);
+    return result;
+  }
+};
+
+// A more expensive specification, to see how the planner moves it to the end
+struct NameSpecification : Specification<Product>
+{
+  string text;
+
+  explicit NameSpecification(const string& text) : text{ text } {}
+
+  bool is_satisfied(Product* item) const override {
+    return item->name.find(text) != string::npos;
+  }
+};
+
+void benchmark_query_planner(size_t count)
+{
+  auto products = make_random_products(count, 11);
+  for (size_t i = 0; i < products.size(); ++i)
+    products[i].name = "item " + to_string(i);
+  auto all = pointers_to(products);
+
+  NameSpecification has_seven("7");
+  ColorSpecification green(Color::green);
+  SizeSpecification large(Size::large);
+
+  // written in the worst order: the expensive and not very selective predicate first
+  auto as_written = has_seven && green;
+  auto spec = as_written && large;
+
+  QueryPlanner<Product> planner{ all };
+  auto planned = planner.all_of({ { "name has 7", has_seven }, { "green", green }, { "large", large } });
+
+  BetterFilter bf;
+  vector<Product*> written_result, planned_result;
+  const double written_ms = measure_ms([&] { written_result = bf.filter(all, spec); });
+  const double planned_ms = measure_ms([&] { planned_result = bf.filter(all, planned); });
+
+  cout << count << " products, name has 7 && green && large -> " << planned_result.size() << " matches\n"
+    << "  as written: " << written_ms << " ms\n"
+    << "  planned: " << planned_ms << " ms"
+    << (written_result == planned_result ? "" : " (MISMATCH!)") << "\n";
+  planned.explain(cout);
+}
+
+void benchmark_materialized_views(size_t count, size_t rounds, size_t updates_per_round)
+{
+  auto products = make_random_products(count, 5);
+  auto all = pointers_to(products);
+  ProductCatalog catalog;
+  catalog.reserve(count);
+  for (auto p : all)
+    catalog.add(p);
+
+  ColorSpecification green(Color::green);
+  SizeSpecification large(Size::large);
+  auto spec = green && large;
+  auto& view = catalog.materialize(spec);
+
+  mt19937 rng{ 9 };
+  uniform_int_distribution<size_t> product_dist{ 0, count - 1 };
+  uniform_int_distribution<int> color_dist{ 0, static_cast<int>(ProductCatalog::color_count) - 1 };
+
+  BetterFilter bf;
+  double update_ms = 0, view_ms = 0, rescan_ms = 0;
+  size_t view_total = 0, rescan_total = 0;
+  for (size_t round = 0; round < rounds; ++round)
+  {
+    update_ms += measure_ms([&] {
+      for (size_t i = 0; i < updates_per_round; ++i)
+        catalog.update(all[product_dist(rng)], [&](Product& p) { p.color = static_cast<Color>(color_dist(rng)); });
+    });
+    view_ms += measure_ms([&] { for (auto p : view.items()) view_total += p->size == Size::large; });
+    rescan_ms += measure_ms([&] { for (auto p : bf.filter(all, spec)) rescan_total += p->size == Size::large; });
+  }
+
+  cout << count << " products, " << rounds << " reads of green && large with " << updates_per_round << " updates before each\n"
+    << "  BetterFilter rescans: " << rescan_ms << " ms\n"
+    << "  MaterializedView reads: " << view_ms << " ms (+ " << update_ms << " ms maintaining it during the updates)"
+    << (view_total == rescan_total ? "" : " (MISMATCH!)") << "\n";
+}
+
 int main()
 {
   Product apple{"Apple", Color::green, Size::small};
@@ -178,6 +1190,50 @@ int main()
   // auto spec2 = SizeSpecification{Size::large} &&
   //              ColorSpecification{Color::blue};
 
+  // same queries answered from the bitmaps of ProductCatalog
+  ProductCatalog catalog;
+  for (auto p : all)
+    catalog.add(p);
+  catalog.add(&tree); // already there, ignored
+  for (auto& x : catalog.filter(spec))
+    cout << x->name << " is green and large (indexed)\n";
+
+  // a view is updated by the catalog, so reading it doesn't filter again
+  auto& green_and_large_view = catalog.materialize(spec);
+  catalog.update(&house, [](Product& p) { p.color = Color::green; });
+  catalog.remove(&tree);
+  for (auto& x : green_and_large_view.items())
+    cout << x->name << " is green and large (view)\n";
+  catalog.update(&house, [](Product& p) { p.color = Color::blue; });
+
+  // the static specifications compose at compile time and can even combine temporaries
+  StaticFilter sf;
+  vector<Product> products{ apple, tree, house };
+  for (auto& x : sf.filter(products, StaticColorSpecification{ Color::green } && !StaticSizeSpecification{ Size::large }))
+    cout << x->name << " is green and not large\n";
+
+  // lazy: the matches are found while iterating, without copying the items
+  LazyFilter<Product> lf;
+  for (auto x : lf.filter(all, spec))
+    cout << x->name << " is green and large (lazy)\n";
+  for (auto x : lf.filter(all, green && large)) // the temporary specification is kept by the range
+    cout << x->name << " is green and large (lazy, temporary specification)\n";
+
+  // the planner decides the order of the predicates from a sample of the items
+  QueryPlanner<Product> planner{ all };
+  auto planned = planner.plan(spec, { "green", "large" });
+  for (auto& x : bf.filter(all, planned))
+    cout << x->name << " is green and large (planned)\n";
+  planned.explain(cout);
+
+  benchmark_catalog(1'000'000);
+  benchmark_static_specifications(1'000'000);
+  // 100M products need around 4GB for the Product array and 800MB more for the pointers of the virtual version
+  //benchmark_static_specifications(100'000'000);
+  benchmark_parallel_filter(1'000'000);
+  benchmark_query_planner(1'000'000);
+  benchmark_materialized_views(1'000'000, 100, 1000);
+
   getchar();
   return 0;
 }
\ No newline at end of file
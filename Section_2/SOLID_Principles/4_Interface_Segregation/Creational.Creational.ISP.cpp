@@ -1,4 +1,18 @@
 #include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <exception>
+#include <system_error>
+using namespace std;
 struct Document;
 
 /*
@@ -81,4 +95,416 @@ struct Machine : IMachine
 };
 
 // IPrinter --> Printer
-// everything --> Machine
\ No newline at end of file
+// everything --> Machine
+
+/*
+* Pipelined machine:
+*
+* Machine does one thing at a time: a document is scanned, then printed, and only then the next one is scanned.
+* When there are thousands of documents going through scan -> OCR -> print, each segregated interface can be a stage
+* of a pipeline instead:
+* - Each stage has its own pool of devices (one worker thread per device), so 4 slow printers print 4 documents
+*   at the same time while the scanner keeps scanning.
+* - Between the stages there are bounded queues. The scanner only waits for the printers when the queue in front of
+*   them is full, which limits the documents in flight (and the memory they use) when printing is slower than scanning.
+* - Each stage counts the documents it processed, the time its workers were busy and the depth of its input queue
+*   (current and peak), so it's easy to see which stage is the bottleneck.
+*
+* The pipeline only uses the small interfaces: a stage doesn't know if a device is a Scanner, a Machine or anything else.
+*/
+
+struct IOcr
+{
+  virtual void recognize(Document& doc) = 0;
+};
+
+template <typename T> class BoundedQueue
+{
+  mutable mutex queue_mutex;
+  condition_variable not_empty, not_full;
+  deque<T> items;
+  size_t capacity;
+  size_t peak = 0;
+  bool closed = false;
+
+public:
+  explicit BoundedQueue(size_t capacity) : capacity{ capacity > 0 ? capacity : 1 } {}
+
+  // Waits while the queue is full, returns false if it was closed
+  bool push(T item)
+  {
+    unique_lock<mutex> lock(queue_mutex);
+    not_full.wait(lock, [&] { return items.size() < capacity || closed; });
+    if (closed)
+      return false;
+    items.push_back(move(item));
+    peak = max(peak, items.size());
+    not_empty.notify_one();
+    return true;
+  }
+
+  // Waits while the queue is empty, returns false when it's closed and there's nothing left
+  bool pop(T& item)
+  {
+    unique_lock<mutex> lock(queue_mutex);
+    not_empty.wait(lock, [&] { return !items.empty() || closed; });
+    if (items.empty())
+      return false;
+    item = move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void close()
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    closed = true;
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+
+  size_t depth() const
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    return items.size();
+  }
+
+  size_t peak_depth() const
+  {
+    lock_guard<mutex> lock(queue_mutex);
+    return peak;
+  }
+};
+
+struct StageStats
+{
+  string name;
+  size_t workers;
+  size_t processed;
+  double busy_seconds;  // summed over the workers
+  size_t queue_depth;
+  size_t peak_queue_depth;
+
+  double throughput(double elapsed_seconds) const { return elapsed_seconds > 0 ? processed / elapsed_seconds : 0; }
+  double utilization(double elapsed_seconds) const
+  {
+    return elapsed_seconds > 0 && workers > 0 ? busy_seconds / (elapsed_seconds * workers) : 0;
+  }
+};
+
+class PipelineStage
+{
+  string name;
+  BoundedQueue<Document*> input;
+  vector<thread> workers;
+  atomic<size_t> processed{ 0 };
+  atomic<long long> busy_nanoseconds{ 0 };
+  atomic<size_t> running{ 0 };
+  mutable mutex error_mutex;
+  exception_ptr error;
+
+  // Keeps the first error and closes the input, so the other workers stop once the queued documents are done
+  void fail(exception_ptr failure)
+  {
+    {
+      lock_guard<mutex> lock(error_mutex);
+      if (!error)
+        error = failure;
+    }
+    input.close();
+  }
+
+public:
+  PipelineStage(const string& name, size_t queue_capacity) : name{ name }, input{ queue_capacity } {}
+
+  ~PipelineStage()
+  {
+    input.close();
+    join();
+  }
+
+  // One worker per device; when the input is closed and empty the last worker calls finished(). An exception of a
+  // device (or of forward) is kept in error() instead of ending the program, and closes the input of the stage.
+  void start(vector<function<void(Document&)>> devices, function<void(Document*)> forward, function<void()> finished)
+  {
+    running = devices.size();
+    for (auto& device : devices)
+    {
+      workers.emplace_back([this, device, forward, finished]
+      {
+        try
+        {
+          Document* doc;
+          while (input.pop(doc))
+          {
+            const auto start = chrono::steady_clock::now();
+            device(*doc);
+            busy_nanoseconds += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            ++processed;
+            forward(doc);
+          }
+        }
+        catch (...)
+        {
+          fail(current_exception());
+        }
+        if (--running == 0)
+          finished();
+      });
+    }
+  }
+
+  exception_ptr first_error() const
+  {
+    lock_guard<mutex> lock(error_mutex);
+    return error;
+  }
+
+  bool push(Document* doc) { return input.push(doc); }
+  void close() { input.close(); }
+
+  void join()
+  {
+    for (auto& worker : workers)
+      if (worker.joinable())
+        worker.join();
+  }
+
+  StageStats stats() const
+  {
+    return { name, workers.size(), processed.load(), busy_nanoseconds.load() / 1e9, input.depth(), input.peak_depth() };
+  }
+};
+
+class PipelinedMachine
+{
+  unique_ptr<PipelineStage> scan_stage, ocr_stage, print_stage;
+  atomic<size_t> completed{ 0 };
+  chrono::steady_clock::time_point started = chrono::steady_clock::now();
+  chrono::steady_clock::time_point finished;
+
+public:
+  // The devices must outlive the machine, each one is used by a single worker thread
+  PipelinedMachine(const vector<IScanner*>& scanners, const vector<IOcr*>& ocrs, const vector<IPrinter*>& printers,
+    size_t queue_capacity = 64)
+    : scan_stage{ new PipelineStage("scan", queue_capacity) },
+      ocr_stage{ new PipelineStage("ocr", queue_capacity) },
+      print_stage{ new PipelineStage("print", queue_capacity) }
+  {
+    // a stage without workers would never close the next one, and finish would wait forever
+    if (scanners.empty() || ocrs.empty() || printers.empty())
+      throw invalid_argument("PipelinedMachine needs at least one scanner, one ocr and one printer");
+
+    vector<function<void(Document&)>> scan_work, ocr_work, print_work;
+    for (auto scanner : scanners)
+      scan_work.push_back([scanner](Document& doc) { scanner->scan(doc); });
+    for (auto ocr : ocrs)
+      ocr_work.push_back([ocr](Document& doc) { ocr->recognize(doc); });
+    for (auto printer : printers)
+      print_work.push_back([printer](Document& doc) { printer->print(doc); });
+
+    // started from the end, so every stage has somewhere to send its documents
+    try
+    {
+      print_stage->start(move(print_work), [this](Document*) { ++completed; }, [] {});
+      ocr_stage->start(move(ocr_work), [this](Document* doc) { print_stage->push(doc); }, [this] { print_stage->close(); });
+      scan_stage->start(move(scan_work), [this](Document* doc) { ocr_stage->push(doc); }, [this] { ocr_stage->close(); });
+    }
+    catch (const system_error&)
+    {
+      // a thread couldn't be started: the ones already running are stopped before the stages are destroyed
+      stop();
+      throw;
+    }
+  }
+
+  // The errors were already thrown by finish() if it was called, the destructor can't throw them
+  ~PipelinedMachine()
+  {
+    stop();
+  }
+
+  // Queues a document for scanning, waits if the scan queue is full. The document must live until finish() returns.
+  // Throws the first error of a device, after that no more documents are accepted.
+  void process(Document& doc)
+  {
+    throw_if_failed();
+    if (!scan_stage->push(&doc))
+      throw_if_failed();
+  }
+
+  // No more documents: waits until all the queued ones have been printed, then throws the first error of a device
+  void finish()
+  {
+    stop();
+    throw_if_failed();
+  }
+
+  size_t documents_completed() const { return completed; }
+
+  double elapsed_seconds() const
+  {
+    const auto end = finished == chrono::steady_clock::time_point{} ? chrono::steady_clock::now() : finished;
+    return chrono::duration<double>(end - started).count();
+  }
+
+  vector<StageStats> stats() const
+  {
+    return { scan_stage->stats(), ocr_stage->stats(), print_stage->stats() };
+  }
+
+private:
+  void stop()
+  {
+    // every stage is closed too, in case the one before it couldn't close it
+    for (auto stage : { scan_stage.get(), ocr_stage.get(), print_stage.get() })
+    {
+      stage->close();
+      stage->join();
+    }
+    if (finished == chrono::steady_clock::time_point{})
+      finished = chrono::steady_clock::now();
+  }
+
+  void throw_if_failed() const
+  {
+    for (auto stage : { scan_stage.get(), ocr_stage.get(), print_stage.get() })
+      if (auto error = stage->first_error())
+        rethrow_exception(error);
+  }
+
+public:
+  void report(ostream& os) const
+  {
+    const double elapsed = elapsed_seconds();
+    os << documents_completed() << " documents in " << elapsed * 1000 << " ms\n";
+    for (auto& stage : stats())
+      os << "  " << stage.name << ": " << stage.workers << " workers, " << stage.throughput(elapsed) << " docs/s, "
+        << stage.utilization(elapsed) * 100 << "% busy, queue " << stage.queue_depth << " (peak " << stage.peak_queue_depth
+        << ")\n";
+  }
+};
+
+struct Document
+{
+  string name;
+  string image;
+  string text;
+  size_t copies = 0;
+
+  Document() = default;
+  explicit Document(const string& name) : name{ name } {}
+};
+
+void Printer::print(Document& doc)
+{
+  ++doc.copies;
+  cout << "Printing " << doc.name << ": " << doc.text << endl;
+}
+
+void Scanner::scan(Document& doc)
+{
+  doc.image = "<image of " + doc.name + ">";
+}
+
+void Machine::scan(Document& doc)
+{
+  scanner.scan(doc);
+}
+
+struct Ocr : IOcr
+{
+  void recognize(Document& doc) override
+  {
+    doc.text = "text recognized from " + doc.image;
+  }
+};
+
+// Devices which take some time, like the real ones
+struct SlowScanner : IScanner
+{
+  chrono::microseconds duration;
+  explicit SlowScanner(chrono::microseconds duration) : duration{ duration } {}
+  void scan(Document& doc) override { this_thread::sleep_for(duration); doc.image = doc.name; }
+};
+
+struct SlowOcr : IOcr
+{
+  chrono::microseconds duration;
+  explicit SlowOcr(chrono::microseconds duration) : duration{ duration } {}
+  void recognize(Document& doc) override { this_thread::sleep_for(duration); doc.text = doc.image; }
+};
+
+struct SlowPrinter : IPrinter
+{
+  chrono::microseconds duration;
+  explicit SlowPrinter(chrono::microseconds duration) : duration{ duration } {}
+  void print(Document& doc) override { this_thread::sleep_for(duration); ++doc.copies; }
+};
+
+// scan 1 ms, OCR 2 ms and print 4 ms per document, one after the other vs 1 scanner, 2 OCR workers and 4 printers
+void benchmark_pipeline(size_t count)
+{
+  vector<Document> documents(count);
+  for (size_t i = 0; i < count; ++i)
+    documents[i].name = "document " + to_string(i);
+
+  SlowScanner scanner{ chrono::milliseconds(1) };
+  vector<SlowOcr> ocrs(2, SlowOcr{ chrono::milliseconds(2) });
+  vector<SlowPrinter> printers(4, SlowPrinter{ chrono::milliseconds(4) });
+
+  const auto start = chrono::steady_clock::now();
+  for (auto& doc : documents)
+  {
+    scanner.scan(doc);
+    ocrs[0].recognize(doc);
+    printers[0].print(doc);
+  }
+  const double sequential_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  cout << count << " documents one after the other in " << sequential_ms << " ms\n";
+
+  vector<IOcr*> ocr_devices;
+  for (auto& ocr : ocrs)
+    ocr_devices.push_back(&ocr);
+  vector<IPrinter*> printer_devices;
+  for (auto& printer : printers)
+    printer_devices.push_back(&printer);
+
+  PipelinedMachine pipeline({ &scanner }, ocr_devices, printer_devices, 16);
+  for (auto& doc : documents)
+    pipeline.process(doc);
+  pipeline.finish();
+
+  size_t printed = 0;
+  for (auto& doc : documents)
+    printed += doc.copies;
+  pipeline.report(cout);
+  if (printed != 2 * count)
+    cout << "  (MISMATCH!)\n";
+}
+
+int main()
+{
+  Printer printer;
+  Scanner scanner;
+  Ocr ocr;
+  Machine machine(printer, scanner);
+
+  Document letter{ "letter" };
+  machine.scan(letter);
+  ocr.recognize(letter);
+  machine.print(letter);
+
+  PipelinedMachine pipeline({ &scanner }, { &ocr }, { &printer });
+  Document invoice{ "invoice" }, receipt{ "receipt" };
+  pipeline.process(invoice);
+  pipeline.process(receipt);
+  pipeline.finish();
+  pipeline.report(cout);
+
+  benchmark_pipeline(500);
+
+  getchar();
+  return 0;
+}
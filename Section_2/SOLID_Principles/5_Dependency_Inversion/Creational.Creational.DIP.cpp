@@ -2,6 +2,31 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <string_view>
+#include <thread>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <exception>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 /*
 * Dependency Inversion Principle:
@@ -43,6 +68,146 @@ struct Person
 struct RelationshipBrowser
 {
   virtual vector<Person> find_all_children_of(const string& name) = 0;
+
+  // Not every low-level module can find the parents, so by default there are none (and no ancestors either). The
+  // modules which can override it.
+  virtual vector<Person> find_all_parents_of(const string&) { return {}; }
+
+  // The children of the children and so on, or the parents of the parents, each person once and in no particular order.
+  // By default they walk find_all_children_of / find_all_parents_of, a low-level module can do it faster (or cache it).
+  virtual vector<Person> find_all_descendants_of(const string& name) { return walk(name, true); }
+  virtual vector<Person> find_all_ancestors_of(const string& name) { return walk(name, false); }
+
+  // Visits the names of the children without building a vector of Person. By default it uses find_all_children_of,
+  // so the low-level modules which already exist don't have to change, but they can override it to avoid the copies.
+  virtual void for_each_child_of(const string& name, const function<void(const string&)>& visit)
+  {
+    for (auto& child : find_all_children_of(name))
+      visit(child.name);
+  }
+
+  virtual ~RelationshipBrowser() = default;
+
+private:
+  vector<Person> walk(const string& name, bool down)
+  {
+    vector<Person> result;
+    unordered_set<string> seen{ name };
+    vector<string> pending{ name };
+    while (!pending.empty())
+    {
+      const string current = move(pending.back());
+      pending.pop_back();
+      for (auto& next : down ? find_all_children_of(current) : find_all_parents_of(current))
+      {
+        if (seen.insert(next.name).second)
+        {
+          pending.push_back(next.name);
+          result.push_back(move(next));
+        }
+      }
+    }
+    return result;
+  }
+};
+
+// Read-only view of a whole file mapped in memory, the pages are loaded by the OS when they are read
+class MappedFile
+{
+  const char* bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  HANDLE file_handle = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+
+public:
+  explicit MappedFile(const string& filename)
+  {
+#ifdef _WIN32
+    file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+      throw runtime_error("can't open " + filename);
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size))
+    {
+      CloseHandle(file_handle);
+      file_handle = INVALID_HANDLE_VALUE;
+      throw runtime_error("can't stat " + filename);
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    if (length == 0)
+      return;
+    mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+      bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!bytes)
+    {
+      unmap();
+      throw runtime_error("can't map " + filename);
+    }
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw runtime_error("can't open " + filename);
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throw runtime_error("can't stat " + filename);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0)
+    {
+      void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED)
+      {
+        ::close(fd);
+        throw runtime_error("can't map " + filename);
+      }
+      madvise(mapped, length, MADV_SEQUENTIAL);
+      bytes = static_cast<const char*>(mapped);
+    }
+    ::close(fd); // the mapping keeps the file alive
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile()
+  {
+    unmap();
+  }
+
+  const char* data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  void unmap()
+  {
+#ifdef _WIN32
+    if (bytes)
+      UnmapViewOfFile(bytes);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file_handle != INVALID_HANDLE_VALUE)
+      CloseHandle(file_handle);
+#else
+    if (bytes)
+      munmap(const_cast<char*>(bytes), length);
+#endif
+  }
+};
+
+struct ImportStats
+{
+  size_t rows = 0;
+  size_t skipped = 0; // lines without "parent,child"
+  double seconds = 0;
+
+  double rows_per_second() const { return seconds > 0 ? rows / seconds : 0; }
 };
 
 struct Relationships : RelationshipBrowser // low-level module, because it stores data
@@ -55,6 +220,78 @@ struct Relationships : RelationshipBrowser // low-level module, because it store
     relations.push_back({child, Relationship::child, parent});
   }
 
+  /*
+  * Bulk import of a CSV file with one "parent,child" pair per line, instead of calling add_parent_and_child for each line:
+  * - The file is mapped in memory, so there's no copy into a stream buffer and no getline.
+  * - The file is split in one chunk per thread at line boundaries. A first parallel pass counts the valid lines of each
+  *   chunk, so the vector is resized once and each chunk knows where its rows go.
+  * - A second parallel pass parses the chunks again and writes both directions of each row directly into their slots,
+  *   so there's no intermediate vector of pairs and no Person copies.
+  * The rows are stored in the same order as the file, the same as calling add_parent_and_child line by line.
+  */
+  ImportStats import_csv(const string& filename, unsigned thread_count = thread::hardware_concurrency())
+  {
+    const auto start = chrono::steady_clock::now();
+    MappedFile file(filename);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    if (thread_count == 0)
+      thread_count = 1;
+    // chunk i is [bounds[i], bounds[i + 1]), every bound except the first one starts after a '\n'
+    vector<const char*> bounds{ begin };
+    for (unsigned i = 1; i < thread_count; ++i)
+    {
+      const char* bound = max(begin + file.size() / thread_count * i, bounds.back());
+      auto line_end = bound < end ? static_cast<const char*>(memchr(bound, '\n', end - bound)) : nullptr;
+      bounds.push_back(line_end ? line_end + 1 : end);
+    }
+    bounds.push_back(end);
+    const size_t chunks = bounds.size() - 1;
+
+    vector<size_t> rows(chunks), skipped(chunks);
+    run_chunks(chunks, [&](size_t chunk) {
+      for_each_row(bounds[chunk], bounds[chunk + 1], [&](string_view, string_view) { ++rows[chunk]; },
+        [&] { ++skipped[chunk]; });
+    });
+
+    ImportStats stats;
+    vector<size_t> first_slot(chunks);
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+      first_slot[chunk] = relations.size() + 2 * stats.rows;
+      stats.rows += rows[chunk];
+      stats.skipped += skipped[chunk];
+    }
+    const size_t old_size = relations.size();
+    relations.resize(old_size + 2 * stats.rows);
+
+    try
+    {
+      run_chunks(chunks, [&](size_t chunk) {
+      size_t slot = first_slot[chunk];
+        for_each_row(bounds[chunk], bounds[chunk + 1], [&](string_view parent, string_view child) {
+          auto& [parent_first, parent_relationship, parent_second] = relations[slot++];
+          parent_first.name.assign(parent.data(), parent.size());
+          parent_relationship = Relationship::parent;
+          parent_second.name.assign(child.data(), child.size());
+          auto& [child_first, child_relationship, child_second] = relations[slot++];
+          child_first.name = parent_second.name;
+          child_relationship = Relationship::child;
+          child_second.name = parent_first.name;
+        }, [] {});
+      });
+    }
+    catch (...)
+    {
+      relations.resize(old_size); // no half-imported rows
+      throw;
+    }
+
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+  }
+
   vector<Person> find_all_children_of(const string &name) override
   {
     vector<Person> result;
@@ -67,16 +304,409 @@ struct Relationships : RelationshipBrowser // low-level module, because it store
     }
     return result;
   }
+
+private:
+  // Calls f(chunk) for each chunk, one thread each. The chunks of the threads which can't be started are done by the
+  // calling thread, and the first exception of any chunk is thrown once all of them have finished.
+  template <typename F> static void run_chunks(size_t chunks, F&& f)
+  {
+    vector<exception_ptr> errors(chunks);
+    auto run = [&](size_t chunk)
+    {
+      try
+      {
+        f(chunk);
+      }
+      catch (...)
+      {
+        errors[chunk] = current_exception(); // an exception escaping a thread would end the program
+      }
+    };
+
+    vector<thread> workers;
+    workers.reserve(chunks);
+    size_t started = 1;
+    try
+    {
+      for (; started < chunks; ++started)
+        workers.emplace_back(run, started);
+    }
+    catch (const system_error&)
+    {
+      // no more threads available, the rest of the chunks are done below
+    }
+    run(0);
+    for (size_t chunk = started; chunk < chunks; ++chunk)
+      run(chunk);
+    for (auto& worker : workers)
+      worker.join();
+    for (auto& error : errors)
+      if (error)
+        rethrow_exception(error);
+  }
+
+  // Calls row(parent, child) for each "parent,child" line and bad() for the non-empty lines without a comma
+  template <typename Row, typename Bad> static void for_each_row(const char* current, const char* end, Row&& row, Bad&& bad)
+  {
+    while (current < end)
+    {
+      auto line_end = static_cast<const char*>(memchr(current, '\n', end - current));
+      if (!line_end)
+        line_end = end;
+      const char* last = line_end;
+      if (last > current && last[-1] == '\r')
+        --last;
+      if (last > current)
+      {
+        auto comma = static_cast<const char*>(memchr(current, ',', last - current));
+        if (comma && comma > current && comma + 1 < last)
+          row(string_view(current, comma - current), string_view(comma + 1, last - comma - 1));
+        else
+          bad();
+      }
+      current = line_end + 1;
+    }
+  }
+};
+
+/*
+* Relationships compares the names of every relation on each query and returns copies of the Person objects, which is fine
+* for a few people but not for millions of relations.
+*
+* RelationshipGraph is another low-level module implementing RelationshipBrowser, so Research works with it through the same
+* interface (Research only switched to for_each_child_of, which RelationshipBrowser got with a default implementation so
+* Relationships didn't have to change):
+* - Each name is stored once and identified by an integer id (interned), so the queries compare integers, not strings.
+* - The relations are stored in compressed sparse row (CSR) style arrays, one per type of relationship: all the related ids
+*   in a single targets array, and for the person with id i the position and length of its row, so finding the children
+*   of someone is two reads instead of a scan of all the relations.
+* - Each row has some free room at its end, like a vector, so add_parent_and_child appends to the row in place. When a row
+*   is full it's moved to the end of targets with twice the room, and when the abandoned rows are more than half of
+*   targets, all the rows are packed again. So there's no other copy of the relations and no rebuild before the queries.
+* - children_of and parents_of return an IdSpan, which only points into those arrays (nothing is copied). The span is valid
+*   until the next relation is added.
+*/
+class RelationshipGraph : public RelationshipBrowser
+{
+public:
+  typedef uint32_t PersonId;
+
+  struct IdSpan
+  {
+    const PersonId* first;
+    const PersonId* last;
+
+    const PersonId* begin() const { return first; }
+    const PersonId* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+  };
+
+  void reserve(size_t people, size_t relations)
+  {
+    names.reserve(people);
+    ids.reserve(people);
+    for (auto& adjacency : rows)
+      adjacency.reserve(people, relations);
+  }
+
+  PersonId intern(const string& name)
+  {
+    auto it = ids.find(name);
+    if (it != ids.end())
+      return it->second;
+    const auto id = static_cast<PersonId>(names.size());
+    names.push_back(name);
+    ids.emplace(name, id);
+    return id;
+  }
+
+  optional<PersonId> find(const string& name) const
+  {
+    auto it = ids.find(name);
+    if (it == ids.end())
+      return nullopt;
+    return it->second;
+  }
+
+  const string& name_of(PersonId id) const { return names.at(id); }
+  size_t people() const { return names.size(); }
+
+  void add_parent_and_child(const Person& parent, const Person& child)
+  {
+    add_parent_and_child(intern(parent.name), intern(child.name));
+  }
+
+  // Both ids must come from intern
+  void add_parent_and_child(PersonId parent, PersonId child)
+  {
+    check(parent);
+    check(child);
+    rows[index(Relationship::parent)].add(parent, child);
+    rows[index(Relationship::child)].add(child, parent);
+    // the new edge only changes the descendants of the parent and of its ancestors, and the ancestors of the child
+    // and of its descendants, which are exactly the cached closures containing (or belonging to) them
+    invalidate(descendant_cache, parent);
+    invalidate(ancestor_cache, child);
+  }
+
+  IdSpan related(PersonId id, Relationship relationship) const
+  {
+    return rows[index(relationship)].row(id);
+  }
+
+  IdSpan children_of(PersonId id) const { return related(id, Relationship::parent); }
+  IdSpan parents_of(PersonId id) const { return related(id, Relationship::child); }
+
+  vector<Person> find_all_children_of(const string& name) override
+  {
+    vector<Person> result;
+    for_each_child_of(name, [&](const string& child) { result.push_back({ child }); });
+    return result;
+  }
+
+  void for_each_child_of(const string& name, const function<void(const string&)>& visit) override
+  {
+    if (auto id = find(name))
+      for (auto child : children_of(*id))
+        visit(names[child]);
+  }
+
+  vector<Person> find_all_parents_of(const string& name) override
+  {
+    vector<Person> result;
+    if (auto id = find(name))
+      for (auto parent : parents_of(*id))
+        result.push_back({ names[parent] });
+    return result;
+  }
+
+  /*
+  * Transitive queries: the children of the children and so on (descendants), or the parents of the parents (ancestors).
+  * The first query walks the graph, the result is kept (sorted by id) and the next queries for the same person just return
+  * it. When a relation parent -> child is added, only the cached results which can change are removed: the descendants of
+  * the parent and of everyone whose descendants contain the parent, and the same for the ancestors of the child.
+  * To find those without looking at every cached result, the cache also keeps, for each person, which cached results
+  * contain it (containing), so adding a relation costs the number of results it removes.
+  * The returned reference is valid until the next relation is added.
+  */
+  const vector<PersonId>& descendants_of(PersonId id) { return closure(id, Relationship::parent, descendant_cache); }
+  const vector<PersonId>& ancestors_of(PersonId id) { return closure(id, Relationship::child, ancestor_cache); }
+
+  vector<Person> find_all_descendants_of(const string& name) override
+  {
+    return to_people(name, descendant_cache, Relationship::parent);
+  }
+
+  vector<Person> find_all_ancestors_of(const string& name) override
+  {
+    return to_people(name, ancestor_cache, Relationship::child);
+  }
+
+  size_t cache_hits() const { return hits; }
+  size_t cache_misses() const { return misses; }
+
+private:
+  struct ClosureCache
+  {
+    struct Closure
+    {
+      vector<PersonId> members;
+      uint32_t generation; // to tell this result from older ones of the same person in containing
+    };
+
+    unordered_map<PersonId, Closure> closures;
+    vector<vector<pair<PersonId, uint32_t>>> containing; // for each person, (owner, generation) of the results with it
+    uint32_t generation = 0;
+  };
+
+  ClosureCache descendant_cache, ancestor_cache;
+  vector<uint32_t> visited; // visited[id] == visit_epoch means visited in the current walk, so it's never cleared
+  uint32_t visit_epoch = 0;
+  size_t hits = 0, misses = 0;
+
+  void check(PersonId id) const
+  {
+    if (id >= names.size())
+      throw out_of_range("unknown person id " + to_string(id));
+  }
+
+  const vector<PersonId>& closure(PersonId id, Relationship relationship, ClosureCache& cache)
+  {
+    check(id);
+    auto it = cache.closures.find(id);
+    if (it != cache.closures.end())
+    {
+      ++hits;
+      return it->second.members;
+    }
+    ++misses;
+
+    if (visited.size() < names.size())
+      visited.resize(names.size(), 0);
+    if (++visit_epoch == 0) // wrapped around, the old marks could be mistaken for the new ones
+    {
+      fill(visited.begin(), visited.end(), 0);
+      visit_epoch = 1;
+    }
+
+    // depth-first walk, a person with two parents in the tree is reported once
+    vector<PersonId> result, stack{ id };
+    visited[id] = visit_epoch;
+    while (!stack.empty())
+    {
+      const PersonId current = stack.back();
+      stack.pop_back();
+      for (auto next : related(current, relationship))
+      {
+        if (visited[next] == visit_epoch)
+          continue;
+        visited[next] = visit_epoch;
+        result.push_back(next);
+        stack.push_back(next);
+      }
+    }
+    sort(result.begin(), result.end());
+
+    const uint32_t generation = ++cache.generation;
+    if (cache.containing.size() < names.size())
+      cache.containing.resize(names.size());
+    for (auto member : result)
+      add_containing(cache, member, id, generation);
+    return cache.closures.emplace(id, ClosureCache::Closure{ move(result), generation }).first->second.members;
+  }
+
+  static bool is_cached(const ClosureCache& cache, PersonId owner, uint32_t generation)
+  {
+    auto it = cache.closures.find(owner);
+    return it != cache.closures.end() && it->second.generation == generation;
+  }
+
+  static void add_containing(ClosureCache& cache, PersonId member, PersonId owner, uint32_t generation)
+  {
+    auto& owners = cache.containing[member];
+    if (!owners.empty() && owners.size() == owners.capacity())
+    {
+      // forget the results removed since they were added, and grow only if at least half of them are still cached
+      owners.erase(remove_if(owners.begin(), owners.end(),
+        [&](const pair<PersonId, uint32_t>& entry) { return !is_cached(cache, entry.first, entry.second); }), owners.end());
+      if (owners.size() > owners.capacity() / 2)
+        owners.reserve(2 * owners.capacity());
+    }
+    owners.emplace_back(owner, generation);
+  }
+
+  // Removes the cached closures of id and of everyone whose closure contains id
+  static void invalidate(ClosureCache& cache, PersonId id)
+  {
+    cache.closures.erase(id);
+    if (id >= cache.containing.size())
+      return;
+    for (auto& [owner, generation] : cache.containing[id])
+      if (is_cached(cache, owner, generation))
+        cache.closures.erase(owner);
+    cache.containing[id].clear();
+  }
+
+  vector<Person> to_people(const string& name, ClosureCache& cache, Relationship relationship)
+  {
+    vector<Person> result;
+    if (auto id = find(name))
+      for (auto other : closure(*id, relationship, cache))
+        result.push_back({ names[other] });
+    return result;
+  }
+
+  // The rows of one relationship, each one with free room at its end
+  class AdjacencyRows
+  {
+    vector<uint64_t> starts;     // position of each row in targets
+    vector<uint32_t> lengths;
+    vector<uint32_t> capacities; // room of each row, lengths[i] <= capacities[i]
+    vector<PersonId> targets;
+    size_t abandoned = 0;        // room of the rows which were moved to the end
+
+  public:
+    void reserve(size_t people, size_t relations)
+    {
+      starts.reserve(people);
+      lengths.reserve(people);
+      capacities.reserve(people);
+      targets.reserve(relations);
+    }
+
+    IdSpan row(PersonId id) const
+    {
+      if (id >= starts.size())
+        return { nullptr, nullptr };
+      const PersonId* first = targets.data() + starts[id];
+      return { first, first + lengths[id] };
+    }
+
+    void add(PersonId from, PersonId to)
+    {
+      if (from >= starts.size())
+      {
+        starts.resize(from + size_t{ 1 }, 0);
+        lengths.resize(from + size_t{ 1 }, 0);
+        capacities.resize(from + size_t{ 1 }, 0);
+      }
+      if (lengths[from] == capacities[from])
+        grow(from);
+      targets[starts[from] + lengths[from]++] = to;
+    }
+
+  private:
+    // Moves the row to the end of targets with twice the room (the old room is abandoned)
+    void grow(PersonId id)
+    {
+      if (abandoned > targets.size() / 2)
+        pack();
+      const uint32_t capacity = max<uint32_t>(2, 2 * capacities[id]);
+      const size_t start = targets.size();
+      targets.resize(start + capacity);
+      copy_n(targets.begin() + starts[id], lengths[id], targets.begin() + start);
+      abandoned += capacities[id];
+      starts[id] = start;
+      capacities[id] = capacity;
+    }
+
+    // All the rows one after the other without free room, so the abandoned rows are freed
+    void pack()
+    {
+      vector<PersonId> packed;
+      packed.reserve(targets.size() - abandoned);
+      for (size_t id = 0; id < starts.size(); ++id)
+      {
+        const size_t start = packed.size();
+        packed.insert(packed.end(), targets.begin() + starts[id], targets.begin() + starts[id] + lengths[id]);
+        starts[id] = start;
+        capacities[id] = lengths[id];
+      }
+      targets.swap(packed);
+      abandoned = 0;
+    }
+  };
+
+  static constexpr size_t relationship_count = 3;
+
+  vector<string> names;
+  unordered_map<string, PersonId> ids;
+  AdjacencyRows rows[relationship_count];
+
+  static size_t index(Relationship relationship) { return static_cast<size_t>(relationship); }
 };
 
 struct Research // high-level module, because it works with data
 {
   Research(RelationshipBrowser& browser)
   {
-    for (auto& child : browser.find_all_children_of("John"))
+    browser.for_each_child_of("John", [](const string& child)
     {
-      cout << "John has a child called " << child.name << endl;
-    }
+      cout << "John has a child called " << child << endl;
+    });
+    for (auto& descendant : browser.find_all_descendants_of("John"))
+      cout << "John is an ancestor of " << descendant.name << endl;
   }
 //  Research(const Relationships& relationships)
 //  {
@@ -91,17 +721,165 @@ struct Research // high-level module, because it works with data
 //  }
 };
 
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Random family tree: the parent of each person is someone created before
+void benchmark_relationship_graph(size_t relations, size_t queries)
+{
+  mt19937 rng{ 3 };
+  vector<pair<string, string>> pairs;
+  pairs.reserve(relations);
+  for (size_t i = 1; i <= relations; ++i)
+    pairs.emplace_back("person " + to_string(uniform_int_distribution<size_t>{ 0, i - 1 }(rng)), "person " + to_string(i));
+
+  Relationships relationships;
+  RelationshipGraph graph;
+  relationships.relations.reserve(2 * relations);
+  graph.reserve(relations + 1, relations);
+  const double tuples_add_ms = measure_ms([&] {
+    for (auto& [parent, child] : pairs)
+      relationships.add_parent_and_child({ parent }, { child });
+  });
+  const double graph_add_ms = measure_ms([&] {
+    for (auto& [parent, child] : pairs)
+      graph.add_parent_and_child({ parent }, { child });
+  });
+
+  vector<string> names;
+  for (size_t i = 0; i < queries; ++i)
+    names.push_back("person " + to_string(uniform_int_distribution<size_t>{ 0, relations / 2 }(rng)));
+
+  size_t tuples_found = 0, graph_found = 0;
+  const double tuples_ms = measure_ms([&] {
+    for (auto& name : names)
+      tuples_found += relationships.find_all_children_of(name).size();
+  });
+  const double graph_ms = measure_ms([&] {
+    for (auto& name : names)
+      graph.for_each_child_of(name, [&](const string&) { ++graph_found; });
+  });
+
+  cout << relations << " relations, " << queries << " child queries\n"
+    << "  Relationships: add " << tuples_add_ms << " ms, queries " << tuples_ms << " ms\n"
+    << "  RelationshipGraph: add " << graph_add_ms << " ms, queries " << graph_ms << " ms"
+    << (tuples_found == graph_found ? "" : " (MISMATCH!)") << "\n";
+}
+
+// Deep tree: every person has a parent close to it, so the closures are long chains
+void benchmark_transitive_queries(size_t people, size_t queries)
+{
+  mt19937 rng{ 5 };
+  RelationshipGraph graph;
+  graph.reserve(people, people);
+  for (RelationshipGraph::PersonId i = 1; i < people; ++i)
+    graph.add_parent_and_child(graph.intern("person " + to_string(i > 8 ? i - 1 - rng() % 8 : 0)),
+      graph.intern("person " + to_string(i)));
+
+  vector<RelationshipGraph::PersonId> targets;
+  for (size_t i = 0; i < queries; ++i)
+    targets.push_back(static_cast<RelationshipGraph::PersonId>(rng() % people));
+
+  size_t first_total = 0, repeated_total = 0;
+  const double first_ms = measure_ms([&] {
+    for (auto id : targets)
+      first_total += graph.ancestors_of(id).size() + graph.descendants_of(id).size();
+  });
+  const double repeated_ms = measure_ms([&] {
+    for (auto id : targets)
+      repeated_total += graph.ancestors_of(id).size() + graph.descendants_of(id).size();
+  });
+
+  // a new leaf only invalidates the ancestor closure of the leaf and the descendant closures of its ancestors
+  graph.add_parent_and_child(targets.front(), graph.intern("newcomer"));
+  size_t after_insert_total = 0;
+  const double after_insert_ms = measure_ms([&] {
+    for (auto id : targets)
+      after_insert_total += graph.ancestors_of(id).size() + graph.descendants_of(id).size();
+  });
+
+  cout << people << " people, " << queries << " ancestor and descendant queries\n"
+    << "  first time: " << first_ms << " ms, repeated: " << repeated_ms << " ms"
+    << (first_total == repeated_total ? "" : " (MISMATCH!)") << "\n"
+    << "  after adding one relation: " << after_insert_ms << " ms, cache hits " << graph.cache_hits()
+    << ", misses " << graph.cache_misses() << "\n";
+}
+
+void benchmark_csv_import(size_t rows)
+{
+  const string filename = "relationships.csv";
+  {
+    mt19937 rng{ 7 };
+    ofstream csv(filename, ios::binary);
+    string line;
+    for (size_t i = 1; i <= rows; ++i)
+    {
+      line = "person " + to_string(rng() % i) + ",person " + to_string(i) + "\n";
+      csv.write(line.data(), line.size());
+    }
+  }
+
+  Relationships one_by_one;
+  const double one_by_one_ms = measure_ms([&] {
+    ifstream csv(filename);
+    string line;
+    while (getline(csv, line))
+    {
+      auto comma = line.find(',');
+      if (comma != string::npos)
+        one_by_one.add_parent_and_child({ line.substr(0, comma) }, { line.substr(comma + 1) });
+    }
+  });
+
+  Relationships bulk;
+  const auto stats = bulk.import_csv(filename);
+  const bool same = one_by_one.relations.size() == bulk.relations.size() &&
+    equal(one_by_one.relations.begin(), one_by_one.relations.end(), bulk.relations.begin(),
+      [](auto& a, auto& b) { return get<0>(a).name == get<0>(b).name && get<1>(a) == get<1>(b) && get<2>(a).name == get<2>(b).name; });
+
+  cout << rows << " CSV rows\n"
+    << "  getline and add_parent_and_child: " << one_by_one_ms << " ms, " << rows / one_by_one_ms * 1000 << " rows/s\n"
+    << "  import_csv (" << thread::hardware_concurrency() << " threads): " << stats.seconds * 1000 << " ms, "
+    << stats.rows_per_second() << " rows/s" << (same ? "" : " (MISMATCH!)") << "\n";
+  remove(filename.c_str());
+}
+
 int main()
 {
   Person parent{"John"};
   Person child1{"Chris"};
   Person child2{"Matt"};
 
+  Person grandchild{"Ann"};
+
   Relationships relationships;
   relationships.add_parent_and_child(parent, child1);
   relationships.add_parent_and_child(parent, child2);
+  relationships.add_parent_and_child(child1, grandchild);
 
   Research _(relationships);
 
+  // the same research over the CSR graph
+  RelationshipGraph graph;
+  graph.add_parent_and_child(parent, child1);
+  graph.add_parent_and_child(parent, child2);
+  graph.add_parent_and_child(child1, grandchild);
+  Research graph_research(graph);
+
+  for (auto& ancestor : graph.find_all_ancestors_of("Ann"))
+    cout << "Ann descends from " << ancestor.name << endl;
+
+  benchmark_relationship_graph(1'000'000, 100);
+  // 50M relations need several GB for the tuples of Relationships, the graph alone needs much less
+  //benchmark_relationship_graph(50'000'000, 100);
+  benchmark_transitive_queries(100'000, 1'000);
+  benchmark_csv_import(1'000'000);
+  // 100M rows is a 3 GB file and 200M tuples, more than 15 GB of memory for Relationships
+  //benchmark_csv_import(100'000'000);
+
   return 0;
 }
\ No newline at end of file
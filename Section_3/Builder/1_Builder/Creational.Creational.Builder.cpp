@@ -2,17 +2,196 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <fstream>
 #include <memory>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include "Creational.Creational.HtmlEscape.h"
 using namespace std;
 
 struct HtmlBuilder;
 
+/*
+* str() creates an ostringstream and an indentation string for every element, and each element returns its whole
+* subtree as a string which is copied again into the stream of its parent. So the text of an element is copied
+* once for each of its ancestors, which is very slow for deep trees.
+*
+* HtmlWriter writes the whole tree in one pass into one buffer given by the caller:
+* - The indentation is appended from a string of spaces created once, not a new string for every line.
+* - The tree is walked with an explicit stack instead of recursion, so nothing is returned and copied upward.
+* - For an ostream, the text is collected in a buffer of 64 KB which is written at once when it's full, instead of
+*   a lot of small writes (and without endl, which flushes the stream on every line).
+* The result is exactly the same text as str(). With escape, the texts are escaped (see Creational.Creational.HtmlEscape.h).
+*/
+struct HtmlWriter
+{
+  static constexpr size_t flush_threshold = 64 * 1024;
+  static constexpr size_t default_min_children = 1024;
+
+  template <typename Element, typename Flush>
+  static void write(const Element& root, string& buffer, bool escape, Flush&& flush, size_t root_level = 0)
+  {
+    struct Frame
+    {
+      const Element* element;
+      size_t next_child;
+      size_t level;
+    };
+
+    vector<Frame> stack{ { &root, 0, root_level } };
+    open(root, root_level, escape, buffer);
+    while (!stack.empty())
+    {
+      if (buffer.size() >= flush_threshold)
+        flush(buffer);
+
+      const Frame frame = stack.back();
+      if (frame.next_child < frame.element->elements.size())
+      {
+        ++stack.back().next_child;
+        const Element& child = frame.element->elements[frame.next_child];
+        open(child, frame.level + 1, escape, buffer);
+        stack.push_back({ &child, 0, frame.level + 1 });
+      }
+      else
+      {
+        close(*frame.element, frame.level, buffer);
+        stack.pop_back();
+      }
+    }
+  }
+
+  template <typename Element> static void write(const Element& root, string& out, bool escape = false)
+  {
+    write(root, out, escape, [](string&) {});
+  }
+
+  template <typename Element> static void write(const Element& root, ostream& os, bool escape = false)
+  {
+    string buffer;
+    buffer.reserve(flush_threshold + 1024);
+    write(root, buffer, escape, [&](string& full) { os.write(full.data(), full.size()); full.clear(); });
+    os.write(buffer.data(), buffer.size());
+  }
+
+  /*
+  * Parallel mode for wide trees (for example a table with a <tr> for each record): the children of the root are split
+  * in one contiguous range per thread, each thread writes its range into its own buffer, and the buffers are appended
+  * in order between the opening and closing tags of the root, so the text is exactly the same as write().
+  * Starting threads costs much more than writing a few elements, so a root with less than min_children children
+  * is written by the calling thread. Where the threads start to pay off depends on the machine and on the size of the
+  * children: default_min_children is a starting point, not a measured value (benchmark_parallel_writer shows both
+  * sides of it, with the threshold disabled).
+  * The ranges of the threads which can't be started are written by the calling thread, and an exception of any range
+  * is thrown once all the threads have finished (out is unchanged then).
+  */
+  template <typename Element>
+  static void write_parallel(const Element& root, string& out, bool escape = false,
+    unsigned thread_count = thread::hardware_concurrency(), size_t min_children = default_min_children)
+  {
+    const size_t children = root.elements.size();
+    if (thread_count < 2 || children < min_children)
+    {
+      write(root, out, escape);
+      return;
+    }
+
+    vector<string> buffers(min<size_t>(thread_count, children));
+    vector<exception_ptr> errors(buffers.size());
+    auto write_range = [&](size_t part)
+    {
+      try
+      {
+        const size_t first = children * part / buffers.size();
+        const size_t last = children * (part + 1) / buffers.size();
+        for (size_t i = first; i < last; ++i)
+          write(root.elements[i], buffers[part], escape, [](string&) {}, 1);
+      }
+      catch (...)
+      {
+        errors[part] = current_exception(); // an exception escaping a thread would end the program
+      }
+    };
+
+    vector<thread> workers;
+    workers.reserve(buffers.size());
+    size_t started = 1;
+    try
+    {
+      for (; started < buffers.size(); ++started)
+        workers.emplace_back(write_range, started);
+    }
+    catch (const system_error&)
+    {
+      // no more threads available, the rest of the ranges are written below
+    }
+    write_range(0);
+    for (size_t part = started; part < buffers.size(); ++part)
+      write_range(part);
+    for (auto& worker : workers)
+      worker.join();
+    for (auto& error : errors)
+      if (error)
+        rethrow_exception(error);
+
+    open(root, 0, escape, out);
+    size_t total = out.size();
+    for (auto& buffer : buffers)
+      total += buffer.size();
+    out.reserve(total + root.name.size() + 4);
+    for (auto& buffer : buffers)
+      out += buffer;
+    close(root, 0, out);
+  }
+
+private:
+  static void indent(string& out, size_t width)
+  {
+    static const string spaces(256, ' ');
+    for (; width > spaces.size(); width -= spaces.size())
+      out.append(spaces);
+    out.append(spaces, 0, width);
+  }
+
+  template <typename Element> static void open(const Element& e, size_t level, bool escape, string& out)
+  {
+    indent(out, e.indent_size * level);
+    out += '<';
+    out += e.name;
+    out += ">\n";
+    if (e.text.size() > 0)
+    {
+      indent(out, e.indent_size * (level + 1));
+      if (escape)
+        append_escaped(out, e.text);
+      else
+        out += e.text;
+      out += '\n';
+    }
+  }
+
+  template <typename Element> static void close(const Element& e, size_t level, string& out)
+  {
+    indent(out, e.indent_size * level);
+    out += "</";
+    out += e.name;
+    out += ">\n";
+  }
+};
+
 struct HtmlElement
 {
   string name;
   string text;
   vector<HtmlElement> elements;
-  const size_t indent_size = 2;
+  static constexpr size_t indent_size = 2; // the same for every element, so it's not stored in each one
 
   HtmlElement() {}
   HtmlElement(const string& name, const string& text)
@@ -36,17 +215,22 @@ struct HtmlElement
     return oss.str();
   }
 
-  // This function is used in main to construct the object in one single line
-  static HtmlBuilder build_base(string root_name)
+  // Same text as str(), appended to out in a single pass (see HtmlWriter)
+  void write_to(string& out, bool escape = false) const { HtmlWriter::write(*this, out, escape); }
+  void write_to(ostream& os, bool escape = false) const { HtmlWriter::write(*this, os, escape); }
+
+  // The same text, with the children of this element written by several threads (see HtmlWriter::write_parallel)
+  void write_to_parallel(string& out, bool escape = false, unsigned thread_count = thread::hardware_concurrency(),
+    size_t min_children = HtmlWriter::default_min_children) const
   {
-      return { root_name };
+    HtmlWriter::write_parallel(*this, out, escape, thread_count, min_children);
   }
 
+  // This function is used in main to construct the object in one single line
+  static HtmlBuilder build_base(string root_name);
+
   // This function is a variation of the previous one to return a pointer instead of a reference
-  static unique_ptr<HtmlBuilder> build(string root_name)
-  {
-    return make_unique<HtmlBuilder>(root_name);
-  }
+  static unique_ptr<HtmlBuilder> build(string root_name);
 };
 
 struct HtmlBuilder
@@ -62,30 +246,851 @@ struct HtmlBuilder
   // the this pointer, so we can call several times the function.
   HtmlBuilder& add_child(string child_name, string child_text)
   {
-    HtmlElement e{ child_name, child_text };
-    root.elements.emplace_back(e);
+    root.elements.emplace_back(move(child_name), move(child_text)); // built in place, not copied
     return *this;
   }
 
   // Here we implement the fluent interface again as a pointer
   HtmlBuilder* add_child_2(string child_name, string child_text)
   {
-    HtmlElement e{ child_name, child_text };
-    root.elements.emplace_back(e);
+    root.elements.emplace_back(move(child_name), move(child_text));
     return this;
   }
 
-  string str() { return root.str(); }
+  // With escaped(), str() and write_to escape the texts (&, <, >, quotes) of the elements
+  HtmlBuilder& escaped(bool on = true)
+  {
+    escape = on;
+    return *this;
+  }
+
+  string str()
+  {
+    string out;
+    root.write_to(out, escape);
+    return out;
+  }
+
+  void write_to(ostream& os) const { root.write_to(os, escape); }
 
   //Operator to return a HtmlElement when creating an object with HtmlBuilder
   operator HtmlElement() const { return std::move(root); } //We can move the element since we won't use the HtmlBuilder object, since we're returning a HtmlElemnt
   HtmlElement root;
+  bool escape = false;
 };
 
+// These are defined here because they return a HtmlBuilder, which must be complete
+HtmlBuilder HtmlElement::build_base(string root_name)
+{
+  return { root_name };
+}
+
+unique_ptr<HtmlBuilder> HtmlElement::build(string root_name)
+{
+  return make_unique<HtmlBuilder>(root_name);
+}
+
 struct HtmlBuilder2;
-class HtmlElement2;
 
-int demo()
+class HtmlElement2
+{
+    friend struct HtmlBuilder2;
+    friend struct HtmlWriter;
+    string name;
+    string text;
+    vector<HtmlElement2> elements;
+    static constexpr size_t indent_size = 2;
+
+    HtmlElement2() {}
+    HtmlElement2(const string& name, const string& text)
+        : name(name),
+        text(text)
+    {
+    }
+
+public:
+    string str(int indent = 0) const
+    {
+        ostringstream oss;
+        string i(indent_size * indent, ' ');
+        oss << i << "<" << name << ">" << endl;
+        if (text.size() > 0)
+            oss << string(indent_size * (indent + 1), ' ') << text << endl;
+
+        for (const auto& e : elements)
+            oss << e.str(indent + 1);
+
+        oss << i << "</" << name << ">" << endl;
+        return oss.str();
+    }
+
+    void write_to(string& out, bool escape = false) const { HtmlWriter::write(*this, out, escape); }
+    void write_to(ostream& os, bool escape = false) const { HtmlWriter::write(*this, os, escape); }
+    void write_to_parallel(string& out, bool escape = false, unsigned thread_count = thread::hardware_concurrency(),
+        size_t min_children = HtmlWriter::default_min_children) const {
+        HtmlWriter::write_parallel(*this, out, escape, thread_count, min_children);
+    }
+
+    static HtmlBuilder2 create(string root_name);
+};
+
+struct HtmlBuilder2
+{
+    HtmlBuilder2(string root_name)
+    {
+        root.name = root_name;
+    }
+
+    HtmlBuilder2& add_child(string child_name, string child_text)
+    {
+        HtmlElement2 e{ move(child_name), move(child_text) };
+        root.elements.push_back(move(e)); // the constructor is private, so vector can't build it in place
+        return *this;
+    }
+
+    HtmlBuilder2* add_child_2(string child_name, string child_text)
+    {
+        HtmlElement2 e{ move(child_name), move(child_text) };
+        root.elements.push_back(move(e)); // the constructor is private, so vector can't build it in place
+        return this;
+    }
+
+    HtmlBuilder2& escaped(bool on = true) {
+        escape = on;
+        return *this;
+    }
+
+    string str() {
+        string out;
+        root.write_to(out, escape);
+        return out;
+    }
+
+    HtmlElement2 build() {
+        return root;
+    }
+
+    operator HtmlElement2() const { return std::move(root); }
+    HtmlElement2 root;
+    bool escape = false;
+};
+
+HtmlBuilder2 HtmlElement2::create(string root_name) {
+    return { root_name };
+}
+
+/*
+* Arena storage:
+*
+* Every HtmlElement owns its name, its text and a vector of children, so a document of 1M elements is millions of
+* small allocations, and destroying it is millions of frees.
+*
+* HtmlArena stores the same tree in two arrays:
+* - nodes, in the order they appear in the html (preorder). The children of a node are the nodes after it up to its
+*   subtree_end, so a node doesn't need a list of children: they are a range of indexes.
+* - chars, where the names and texts of all the nodes are stored one after the other. A node only has offsets into it.
+* Both arrays grow by doubling, so building the document is a few big allocations, and clear() or the destructor
+* frees everything in one step.
+*
+* HtmlArenaBuilder has the same fluent add_child as HtmlBuilder, and open/close to build nested elements.
+* The html text is the same as the one of an HtmlElement with the same tree.
+*/
+class HtmlArena
+{
+public:
+  static constexpr size_t indent_size = 2;
+
+  struct Node
+  {
+    uint32_t name_offset, name_length;
+    uint32_t text_offset, text_length;
+    uint32_t subtree_end; // one past the last descendant
+  };
+
+  size_t size() const { return nodes.size(); }
+  size_t bytes() const { return nodes.capacity() * sizeof(Node) + chars.capacity(); }
+
+  string name(uint32_t node) const { return chars.substr(nodes[node].name_offset, nodes[node].name_length); }
+  string text(uint32_t node) const { return chars.substr(nodes[node].text_offset, nodes[node].text_length); }
+  uint32_t subtree_end(uint32_t node) const { return nodes[node].subtree_end; }
+
+  void reserve(size_t node_count, size_t char_count)
+  {
+    nodes.reserve(node_count);
+    chars.reserve(char_count);
+  }
+
+  void clear()
+  {
+    vector<Node>().swap(nodes);
+    string().swap(chars);
+  }
+
+  // Children are nodes node + 1 ... subtree_end - 1, skipping the subtree of each child
+  template <typename F> void for_each_child(uint32_t node, F&& f) const
+  {
+    for (uint32_t child = node + 1; child < nodes[node].subtree_end; child = nodes[child].subtree_end)
+      f(child);
+  }
+
+  void write_to(string& out) const
+  {
+    vector<uint32_t> open; // the nodes whose closing tag hasn't been written yet
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+    {
+      while (!open.empty() && nodes[open.back()].subtree_end <= i)
+      {
+        close(open.back(), open.size() - 1, out);
+        open.pop_back();
+      }
+      const Node& node = nodes[i];
+      indent(out, open.size());
+      out += '<';
+      out.append(chars, node.name_offset, node.name_length);
+      out += ">\n";
+      if (node.text_length > 0)
+      {
+        indent(out, open.size() + 1);
+        out.append(chars, node.text_offset, node.text_length);
+        out += '\n';
+      }
+      open.push_back(i);
+    }
+    while (!open.empty())
+    {
+      close(open.back(), open.size() - 1, out);
+      open.pop_back();
+    }
+  }
+
+  string str() const
+  {
+    string out;
+    write_to(out);
+    return out;
+  }
+
+private:
+  friend class HtmlArenaBuilder;
+
+  vector<Node> nodes;
+  string chars;
+
+  uint32_t store(const string& value, bool escape)
+  {
+    const auto offset = static_cast<uint32_t>(chars.size());
+    if (escape)
+      append_escaped(chars, value);
+    else
+      chars += value;
+    if (chars.size() > numeric_limits<uint32_t>::max())
+      throw length_error("HtmlArena is limited to 4 GB of text");
+    return offset;
+  }
+
+  // The text is stored already escaped, so writing the arena doesn't need to know about it
+  uint32_t add_node(const string& name, const string& text, bool escape)
+  {
+    if (nodes.size() >= numeric_limits<uint32_t>::max())
+      throw length_error("too many nodes for HtmlArena");
+    Node node;
+    node.name_offset = store(name, false);
+    node.name_length = static_cast<uint32_t>(name.size());
+    node.text_offset = store(text, escape);
+    node.text_length = static_cast<uint32_t>(chars.size() - node.text_offset);
+    node.subtree_end = static_cast<uint32_t>(nodes.size() + 1);
+    nodes.push_back(node);
+    return static_cast<uint32_t>(nodes.size() - 1);
+  }
+
+  static void indent(string& out, size_t level)
+  {
+    out.append(level * indent_size, ' ');
+  }
+
+  void close(uint32_t node, size_t level, string& out) const
+  {
+    indent(out, level);
+    out += "</";
+    out.append(chars, nodes[node].name_offset, nodes[node].name_length);
+    out += ">\n";
+  }
+};
+
+class HtmlArenaBuilder
+{
+  HtmlArena arena;
+  vector<uint32_t> open_nodes; // the root and the elements opened with open()
+  bool escape = false;
+
+public:
+  HtmlArenaBuilder(const string& root_name, const string& root_text = "")
+  {
+    open(root_name, root_text);
+  }
+
+  void reserve(size_t node_count, size_t char_count) { arena.reserve(node_count, char_count); }
+
+  // The texts of the elements added after this are escaped
+  HtmlArenaBuilder& escaped(bool on = true)
+  {
+    escape = on;
+    return *this;
+  }
+
+  // Adds an element without children to the element which is open now
+  HtmlArenaBuilder& add_child(const string& child_name, const string& child_text)
+  {
+    arena.add_node(child_name, child_text, escape);
+    return *this;
+  }
+
+  // The next elements are added as children of this one until close() is called
+  HtmlArenaBuilder& open(const string& child_name, const string& child_text = "")
+  {
+    open_nodes.push_back(arena.add_node(child_name, child_text, escape));
+    return *this;
+  }
+
+  HtmlArenaBuilder& close()
+  {
+    if (open_nodes.size() > 1) // the root is closed by build()
+    {
+      arena.nodes[open_nodes.back()].subtree_end = static_cast<uint32_t>(arena.nodes.size());
+      open_nodes.pop_back();
+    }
+    return *this;
+  }
+
+  HtmlArena build()
+  {
+    for (auto node : open_nodes)
+      arena.nodes[node].subtree_end = static_cast<uint32_t>(arena.nodes.size());
+    open_nodes.clear();
+    return move(arena);
+  }
+};
+
+/*
+* Streaming builder:
+*
+* HtmlBuilder and HtmlArenaBuilder keep the whole document in memory until it's written. For a report of several GB
+* that's not possible, and not needed either, because the elements are added in the same order they are written.
+*
+* HtmlStreamBuilder has the same fluent add_child, but it writes each tag as soon as it's known: add_child writes the
+* whole child, open writes the opening tag and close the closing one. The only thing kept in memory is the name of each
+* open element (to write its closing tag), so the memory is proportional to the depth of the document, not its size.
+* The text is collected in a 64 KB buffer which is written to the stream at once when it's full.
+* finish() (or the destructor) closes the elements which are still open, including the root.
+*/
+class HtmlStreamBuilder
+{
+  static constexpr size_t indent_size = 2;
+  static constexpr size_t flush_threshold = 64 * 1024;
+
+  ostream& sink;
+  string buffer;
+  vector<string> open_names;
+  bool escape = false;
+
+public:
+  HtmlStreamBuilder(ostream& sink, const string& root_name, const string& root_text = "")
+    : sink{ sink }
+  {
+    buffer.reserve(flush_threshold + 1024);
+    open(root_name, root_text);
+  }
+
+  // The texts of the elements added after this are escaped (the root is already written)
+  HtmlStreamBuilder& escaped(bool on = true)
+  {
+    escape = on;
+    return *this;
+  }
+
+  HtmlStreamBuilder(const HtmlStreamBuilder&) = delete;
+  HtmlStreamBuilder& operator=(const HtmlStreamBuilder&) = delete;
+
+  ~HtmlStreamBuilder()
+  {
+    finish();
+  }
+
+  HtmlStreamBuilder& add_child(const string& child_name, const string& child_text)
+  {
+    write_open(child_name, child_text);
+    write_close(child_name, open_names.size());
+    flush_if_full();
+    return *this;
+  }
+
+  HtmlStreamBuilder& open(const string& child_name, const string& child_text = "")
+  {
+    write_open(child_name, child_text);
+    open_names.push_back(child_name);
+    flush_if_full();
+    return *this;
+  }
+
+  HtmlStreamBuilder& close()
+  {
+    if (open_names.size() > 1) // the root is closed by finish()
+      close_last();
+    return *this;
+  }
+
+  void finish()
+  {
+    while (!open_names.empty())
+      close_last();
+    flush();
+  }
+
+  void flush()
+  {
+    sink.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+private:
+  void indent(size_t level)
+  {
+    buffer.append(level * indent_size, ' ');
+  }
+
+  void write_open(const string& name, const string& text)
+  {
+    const size_t level = open_names.size();
+    indent(level);
+    buffer += '<';
+    buffer += name;
+    buffer += ">\n";
+    if (text.size() > 0)
+    {
+      indent(level + 1);
+      if (escape)
+        append_escaped(buffer, text);
+      else
+        buffer += text;
+      buffer += '\n';
+    }
+  }
+
+  void write_close(const string& name, size_t level)
+  {
+    indent(level);
+    buffer += "</";
+    buffer += name;
+    buffer += ">\n";
+  }
+
+  void close_last()
+  {
+    write_close(open_names.back(), open_names.size() - 1);
+    open_names.pop_back();
+    flush_if_full();
+  }
+
+  void flush_if_full()
+  {
+    if (buffer.size() >= flush_threshold)
+      flush();
+  }
+};
+
+/*
+* Incremental rendering:
+*
+* When the same document is rendered again and again with only a few changes, most of the text is the same as the last
+* time. HtmlDocument keeps, for each element, the text it produced the last time (its fragment) and whether it changed
+* since then (dirty):
+* - Every change (set_text, set_name, add_child) marks the element and its ancestors as dirty. It stops at the first
+*   ancestor which is already dirty, because its ancestors are dirty too.
+* - When rendering, a clean element appends its fragment (a cache hit) instead of walking its subtree, and a dirty one
+*   is rendered again (a miss), reusing the fragments of its clean children.
+* Each fragment also contains the text of the subtree, so caching every level would store the deep elements once for
+* each ancestor. Only the elements in the first cache_levels levels keep a fragment; the deeper ones are rendered as
+* part of their cached ancestor. The root is always cached (cache_levels is at least 1): its fragment is the document.
+* The text is the same as the one of the HtmlElement with the same tree.
+*/
+class HtmlDocument
+{
+public:
+  typedef uint32_t NodeId;
+  static constexpr size_t indent_size = 2;
+
+  HtmlDocument(const string& root_name, const string& root_text = "", size_t cache_levels = 3)
+    : cache_levels{ max<size_t>(cache_levels, 1) }
+  {
+    nodes.push_back({ root_name, root_text, {}, 0, 0, "", true });
+  }
+
+  // Copies a tree made with HtmlBuilder
+  explicit HtmlDocument(const HtmlElement& root, size_t cache_levels = 3)
+    : HtmlDocument(root.name, root.text, cache_levels)
+  {
+    copy_children(root, 0);
+  }
+
+  NodeId root() const { return 0; }
+  size_t size() const { return nodes.size(); }
+
+  NodeId add_child(NodeId parent, const string& child_name, const string& child_text)
+  {
+    const auto id = static_cast<NodeId>(nodes.size());
+    nodes.push_back({ child_name, child_text, {}, parent, nodes[parent].level + 1, "", true });
+    nodes[parent].children.push_back(id);
+    touch(parent);
+    return id;
+  }
+
+  const string& text(NodeId id) const { return nodes[id].text; }
+  const string& name(NodeId id) const { return nodes[id].name; }
+  const vector<NodeId>& children(NodeId id) const { return nodes[id].children; }
+
+  void set_text(NodeId id, const string& text)
+  {
+    nodes[id].text = text;
+    touch(id);
+  }
+
+  void set_name(NodeId id, const string& name)
+  {
+    nodes[id].name = name;
+    touch(id);
+  }
+
+  // The text of the whole document, valid until the next change
+  const string& render()
+  {
+    Node& root = nodes[0];
+    if (!root.dirty)
+    {
+      ++hits;
+      return root.fragment;
+    }
+    ++misses;
+    root.fragment.clear(); // keeps its capacity for the new text
+    write(root, root.fragment);
+    root.dirty = false;
+    return root.fragment;
+  }
+
+  string str() { return render(); }
+  void write_to(ostream& os) { const string& text = render(); os.write(text.data(), text.size()); }
+
+  size_t cache_hits() const { return hits; }
+  size_t cache_misses() const { return misses; }
+
+private:
+  struct Node
+  {
+    string name;
+    string text;
+    vector<NodeId> children;
+    NodeId parent;
+    size_t level;
+    string fragment; // only for the elements with level < cache_levels
+    bool dirty;
+  };
+
+  vector<Node> nodes;
+  size_t cache_levels;
+  size_t hits = 0, misses = 0;
+
+  bool cached(const Node& node) const { return node.level < cache_levels; }
+
+  void touch(NodeId id)
+  {
+    for (;;)
+    {
+      Node& node = nodes[id];
+      if (cached(node) && node.dirty)
+        return;
+      node.dirty = true;
+      if (id == 0)
+        return;
+      id = node.parent;
+    }
+  }
+
+  void copy_children(const HtmlElement& element, NodeId id)
+  {
+    for (const auto& child : element.elements)
+      copy_children(child, add_child(id, child.name, child.text));
+  }
+
+  void render(NodeId id, string& out)
+  {
+    Node& node = nodes[id];
+    if (!cached(node))
+    {
+      write(node, out);
+      return;
+    }
+    if (!node.dirty)
+    {
+      ++hits;
+      out += node.fragment;
+      return;
+    }
+    ++misses;
+    string fragment;
+    fragment.reserve(node.fragment.size()); // about the same size as the last time
+    write(node, fragment);
+    node.fragment = move(fragment);
+    node.dirty = false;
+    out += node.fragment;
+  }
+
+  void write(const Node& node, string& out)
+  {
+    out.append(node.level * indent_size, ' ');
+    out += '<';
+    out += node.name;
+    out += ">\n";
+    if (node.text.size() > 0)
+    {
+      out.append((node.level + 1) * indent_size, ' ');
+      out += node.text;
+      out += '\n';
+    }
+    for (auto child : node.children)
+      render(child, out);
+    out.append(node.level * indent_size, ' ');
+    out += "</";
+    out += node.name;
+    out += ">\n";
+  }
+};
+
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename Element> void benchmark_serializer(const string& title, const Element& root)
+{
+  string old_text, buffer_text;
+  const double str_ms = measure_ms([&] { old_text = root.str(); });
+  const double buffer_ms = measure_ms([&] { root.write_to(buffer_text); });
+  ostringstream oss;
+  const double stream_ms = measure_ms([&] { root.write_to(oss); });
+
+  cout << title << " (" << old_text.size() << " bytes): str() " << str_ms << " ms, write_to(string) " << buffer_ms
+    << " ms, write_to(ostream) " << stream_ms << " ms"
+    << (old_text == buffer_text && old_text == oss.str() ? "" : " (MISMATCH!)") << "\n";
+}
+
+void benchmark_serializers(size_t depth, size_t width)
+{
+  // each element of the chain is the only child of the previous one
+  HtmlElement deep{ "div", "level 0" };
+  HtmlElement* current = &deep;
+  for (size_t level = 1; level < depth; ++level)
+  {
+    current->elements.emplace_back("div", "level " + to_string(level));
+    current = &current->elements.back();
+  }
+  benchmark_serializer("HtmlElement, " + to_string(depth) + " levels", deep);
+
+  HtmlBuilder wide{ "ul" };
+  HtmlBuilder2 wide2 = HtmlElement2::create("ul");
+  for (size_t i = 0; i < width; ++i)
+  {
+    wide.add_child("li", "item " + to_string(i));
+    wide2.add_child("li", "item " + to_string(i));
+  }
+  benchmark_serializer("HtmlElement, " + to_string(width) + " children", wide.root);
+  benchmark_serializer("HtmlElement2, " + to_string(width) + " children", wide2.root);
+}
+
+// Escaping text without special characters (the usual case) and text with some of them
+void benchmark_escaping(size_t width)
+{
+  string clean_text = "A paragraph of report text without any markup characters in it, just words and numbers 12345. ";
+  string dirty_text = "Prices for <b>A & B</b> are \"high\" > low, isn't it? ";
+  for (int i = 0; i < 3; ++i)
+  {
+    clean_text += clean_text;
+    dirty_text += dirty_text;
+  }
+
+  for (const string* text : { &clean_text, &dirty_text })
+  {
+    string plain, scalar, simd;
+    plain.reserve(text->size() * width);
+    scalar.reserve(text->size() * width * 2);
+    simd.reserve(text->size() * width * 2);
+    const double plain_ms = measure_ms([&] {
+      for (size_t i = 0; i < width; ++i)
+        plain += *text;
+    });
+    const double scalar_ms = measure_ms([&] {
+      for (size_t i = 0; i < width; ++i)
+        append_escaped_scalar(scalar, *text);
+    });
+    const double simd_ms = measure_ms([&] {
+      for (size_t i = 0; i < width; ++i)
+        append_escaped(simd, *text);
+    });
+    cout << (text == &clean_text ? "Text without special characters" : "Text with special characters") << ", "
+      << width << " times: not escaped " << plain_ms << " ms, escaped one character at a time " << scalar_ms
+      << " ms, escaped with append_escaped " << simd_ms << " ms" << (scalar == simd ? "" : " (MISMATCH!)") << "\n";
+  }
+
+  HtmlBuilder list{ "ul" };
+  for (size_t i = 0; i < width; ++i)
+    list.add_child("li", clean_text);
+  string raw, escaped;
+  const double raw_ms = measure_ms([&] { list.root.write_to(raw); });
+  const double escaped_ms = measure_ms([&] { list.root.write_to(escaped, true); });
+  cout << "  HtmlElement::write_to of " << width << " clean elements: " << raw_ms << " ms, escaped " << escaped_ms
+    << " ms" << (raw == escaped ? "" : " (MISMATCH!)") << "\n";
+}
+
+// A table rendered again after changing a few cells, the HtmlElement is written completely every time
+void benchmark_incremental_render(size_t rows, size_t columns, size_t changes)
+{
+  HtmlElement table{ "table", "" };
+  for (size_t r = 0; r < rows; ++r)
+  {
+    table.elements.emplace_back("tr", "");
+    for (size_t c = 0; c < columns; ++c)
+      table.elements.back().elements.emplace_back("td", "cell " + to_string(r) + "," + to_string(c));
+  }
+  HtmlDocument document{ table };
+  document.render();
+
+  mt19937 rng{ 11 };
+  for (size_t i = 0; i < changes; ++i)
+  {
+    const size_t r = rng() % rows, c = rng() % columns;
+    const string text = "changed " + to_string(i);
+    table.elements[r].elements[c].text = text;
+    document.set_text(document.children(document.children(document.root())[r])[c], text);
+  }
+
+  string full;
+  const double full_ms = measure_ms([&] { table.write_to(full); });
+  const size_t hits = document.cache_hits(), misses = document.cache_misses();
+  const string* incremental = nullptr;
+  const double incremental_ms = measure_ms([&] { incremental = &document.render(); });
+
+  cout << rows << "x" << columns << " table, " << changes << " cells changed: write_to " << full_ms
+    << " ms, HtmlDocument::render " << incremental_ms << " ms (" << document.cache_hits() - hits << " hits, "
+    << document.cache_misses() - misses << " misses)" << (full == *incremental ? "" : " (MISMATCH!)") << "\n";
+}
+
+// A table with a <tr> for each record, written by one thread and by several. min_children is 0, so the threads are
+// started even for small tables, to see where they pay off.
+void benchmark_parallel_writer(size_t rows, size_t columns)
+{
+  HtmlElement table{ "table", "" };
+  for (size_t r = 0; r < rows; ++r)
+  {
+    table.elements.emplace_back("tr", "");
+    for (size_t c = 0; c < columns; ++c)
+      table.elements.back().elements.emplace_back("td", "cell " + to_string(r) + "," + to_string(c));
+  }
+
+  string serial;
+  const double serial_ms = measure_ms([&] { table.write_to(serial); });
+  cout << rows << "x" << columns << " table: write_to " << serial_ms << " ms\n";
+  for (unsigned threads : { 2u, 4u, 8u })
+  {
+    string parallel;
+    const double parallel_ms = measure_ms([&] { table.write_to_parallel(parallel, false, threads, 0); });
+    cout << "  write_to_parallel with " << threads << " threads: " << parallel_ms << " ms"
+      << (parallel == serial ? "" : " (MISMATCH!)") << "\n";
+  }
+}
+
+// Writes the same list of lists to a file with a tree in memory and with the streaming builder
+void benchmark_stream_builder(size_t groups, size_t width)
+{
+  const string filename = "report.html";
+  size_t tree_bytes = 0;
+  const double tree_ms = measure_ms([&] {
+    HtmlElement body{ "body", "" };
+    for (size_t g = 0; g < groups; ++g)
+    {
+      body.elements.emplace_back("ul", "group " + to_string(g));
+      for (size_t i = 0; i < width / groups; ++i)
+        body.elements.back().elements.emplace_back("li", "item " + to_string(i));
+    }
+    ofstream file(filename, ios::binary);
+    body.write_to(file);
+    tree_bytes = static_cast<size_t>(file.tellp());
+  });
+
+  size_t stream_bytes = 0;
+  const double stream_ms = measure_ms([&] {
+    ofstream file(filename, ios::binary);
+    {
+      HtmlStreamBuilder builder{ file, "body" };
+      for (size_t g = 0; g < groups; ++g)
+      {
+        builder.open("ul", "group " + to_string(g));
+        for (size_t i = 0; i < width / groups; ++i)
+          builder.add_child("li", "item " + to_string(i));
+        builder.close();
+      }
+    }
+    stream_bytes = static_cast<size_t>(file.tellp());
+  });
+  remove(filename.c_str());
+
+  cout << "Report of " << stream_bytes / (1024 * 1024) << " MB\n"
+    << "  HtmlElement tree and write_to: " << tree_ms << " ms\n"
+    << "  HtmlStreamBuilder: " << stream_ms << " ms, " << stream_bytes / (stream_ms * 1000) << " MB/s"
+    << (tree_bytes == stream_bytes ? "" : " (MISMATCH!)") << "\n";
+}
+
+// A list of lists: groups elements with children of their own, width / groups items each
+void benchmark_arena(size_t groups, size_t width)
+{
+  unique_ptr<HtmlElement> elements;
+  HtmlArena arena;
+  const double elements_build_ms = measure_ms([&] {
+    elements = make_unique<HtmlElement>("body", "");
+    for (size_t g = 0; g < groups; ++g)
+    {
+      elements->elements.emplace_back("ul", "group " + to_string(g));
+      auto& group = elements->elements.back();
+      for (size_t i = 0; i < width / groups; ++i)
+        group.elements.emplace_back("li", "item " + to_string(i));
+    }
+  });
+  const double arena_build_ms = measure_ms([&] {
+    HtmlArenaBuilder builder{ "body" };
+    for (size_t g = 0; g < groups; ++g)
+    {
+      builder.open("ul", "group " + to_string(g));
+      for (size_t i = 0; i < width / groups; ++i)
+        builder.add_child("li", "item " + to_string(i));
+      builder.close();
+    }
+    arena = builder.build();
+  });
+
+  string elements_text, arena_text;
+  const double elements_write_ms = measure_ms([&] { elements->write_to(elements_text); });
+  const double arena_write_ms = measure_ms([&] { arena.write_to(arena_text); });
+  const double elements_free_ms = measure_ms([&] { elements.reset(); });
+  const size_t nodes = arena.size();
+  const double arena_free_ms = measure_ms([&] { arena.clear(); });
+
+  cout << nodes << " nodes\n"
+    << "  HtmlElement: build " << elements_build_ms << " ms, write " << elements_write_ms << " ms, free "
+    << elements_free_ms << " ms\n"
+    << "  HtmlArena: build " << arena_build_ms << " ms, write " << arena_write_ms << " ms, free "
+    << arena_free_ms << " ms" << (elements_text == arena_text ? "" : " (MISMATCH!)") << "\n";
+}
+
+int main()
 {
     /*
     * The two examples shown here are simple string concatenation to create a website text.
@@ -157,73 +1162,42 @@ int demo()
     HtmlElement2 elem = HtmlElement2::create("root_name").add_child("Hello", "World").build();
 
     cout << elem.str() << endl;
-    getchar();
-    return 0;
-}
 
-class HtmlElement2
-{
-    friend struct HtmlBuilder2;
-    string name;
-    string text;
-    vector<HtmlElement2> elements;
-    const size_t indent_size = 2;
-
-    HtmlElement2() {}
-    HtmlElement2(const string& name, const string& text)
-        : name(name),
-        text(text)
-    {
-    }
-
-public:
-    string str(int indent = 0) const
-    {
-        ostringstream oss;
-        string i(indent_size * indent, ' ');
-        oss << i << "<" << name << ">" << endl;
-        if (text.size() > 0)
-            oss << string(indent_size * (indent + 1), ' ') << text << endl;
-
-        for (const auto& e : elements)
-            oss << e.str(indent + 1);
-
-        oss << i << "</" << name << ">" << endl;
-        return oss.str();
-    }
+    // the same text written in one pass into a buffer or a stream
+    string html;
+    builder3.write_to(html);
+    elem.write_to(cout);
+    cout << html << endl;
 
-    static HtmlBuilder2 create(string root_name) {
-        return { root_name };
-    }
-};
+    // the elements of the chain are destroyed recursively, so very deep chains would need a bigger stack
+    benchmark_serializers(1'000, 1'000'000);
 
-struct HtmlBuilder2
-{
-    HtmlBuilder2(string root_name)
-    {
-        root.name = root_name;
-    }
-
-    HtmlBuilder2& add_child(string child_name, string child_text)
-    {
-        HtmlElement e{ child_name, child_text };
-        root.elements.emplace_back(e);
-        return *this;
-    }
+    // the same kind of document stored in an arena
+    HtmlArena page = HtmlArenaBuilder{ "ul" }.add_child("li", "hello").open("li").add_child("b", "world").close().build();
+    cout << page.str() << endl;
+    benchmark_arena(1'000, 1'000'000);
 
-    HtmlBuilder2* add_child_2(string child_name, string child_text)
+    // written while it's built, without keeping the document in memory
     {
-        HtmlElement e{ child_name, child_text };
-        root.elements.emplace_back(e);
-        return this;
+      HtmlStreamBuilder stream{ cout, "ul" };
+      stream.add_child("li", "hello").open("li").add_child("b", "world").close();
     }
+    benchmark_stream_builder(1'000, 10'000'000);
 
-    string str() { return root.str(); }
+    // escaping, enabled for each builder
+    cout << HtmlBuilder{ "p" }.escaped().add_child("b", "Fish & <Chips>").str() << endl;
+    benchmark_escaping(100'000);
 
-    HtmlElement2 build() {
-        return root;
-    }
+    // only the changed elements are rendered again
+    HtmlDocument document{ builder3 };
+    cout << document.render();
+    document.set_text(document.children(document.root())[1], "there");
+    cout << document.render() << "hits " << document.cache_hits() << ", misses " << document.cache_misses() << endl;
+    benchmark_incremental_render(100'000, 10, 10);
 
-    operator HtmlElement2() const { return std::move(root); }
-    HtmlElement2 root;
-};
\ No newline at end of file
+    // wide trees written by several threads, the same text as write_to
+    benchmark_parallel_writer(100, 10);
+    benchmark_parallel_writer(100'000, 10);
+    getchar();
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <array>
+#include <string_view>
+#include <chrono>
+#include "Creational.Creational.HtmlEscape.h"
 
 /*
 * Here the idea is the same which is creating Html code in C++.
@@ -18,29 +22,56 @@ namespace html {
     //we define the ostream operator to print al the tags correctly
     friend std::ostream& operator<<(std::ostream& os, const Tag& tag)
     {
-      os << "<" << tag.name;
+      std::string out;
+      tag.write_to(out, false);
+      return os << out;
+    }
+
+    // The whole tree is appended to one string, which is written to the stream at once.
+    // With escape, the text and the values of the attributes are escaped (see Creational.Creational.HtmlEscape.h).
+    void write_to(std::string& out, bool escape) const
+    {
+      auto append_text = [&](const std::string& value)
+      {
+        if (escape)
+          append_escaped(out, value);
+        else
+          out += value;
+      };
 
-      for (const auto& att : tag.attributes)
-        os << " " << att.first << "=\"" << att.second << "\"";
+      out += "<";
+      out += name;
 
-      if (tag.children.size() == 0 && tag.text.length() == 0)
+      for (const auto& att : attributes)
       {
-        os << "/>" << std::endl;
-      } 
+        out += " ";
+        out += att.first;
+        out += "=\"";
+        append_text(att.second);
+        out += "\"";
+      }
+
+      if (children.size() == 0 && text.length() == 0)
+      {
+        out += "/>\n";
+      }
       else
       {
-        os << ">" << std::endl;
+        out += ">\n";
 
-        if (tag.text.length())
-          os << tag.text << std::endl;
+        if (text.length())
+        {
+          append_text(text);
+          out += "\n";
+        }
 
-        for (const auto& child : tag.children)
-          os << child;
+        for (const auto& child : children)
+          child.write_to(out, escape);
 
-        os << "</" << tag.name << ">" << std::endl;
+        out += "</";
+        out += name;
+        out += ">\n";
       }
-
-      return os;
     }
   protected:
 
@@ -80,6 +111,179 @@ namespace html {
       attributes.emplace_back(make_pair("src", url));
     }
   };
+
+  // Prints a tag with its text and attributes escaped: std::cout << Escaped{ P{ "Fish & Chips" } }
+  struct Escaped
+  {
+    const Tag& tag;
+
+    friend std::ostream& operator<<(std::ostream& os, const Escaped& escaped)
+    {
+      std::string out;
+      escaped.tag.write_to(out, true);
+      return os << out;
+    }
+  };
+}
+
+/*
+* Compile-time tags:
+*
+* When a tree of tags is completely known when the program is compiled, there's no need to build the vectors of Tag
+* and write them every time. html::constant has functions with the same names (P and IMG) which are constexpr: they
+* produce the text of the tags while compiling, and it's stored in the program like a string literal.
+*
+*   constexpr auto page = html::constant::P(html::constant::IMG("http://pokemon.com/pikachu.png"));
+*   std::cout << page.view(); // nothing is built at runtime
+*
+* A few parts may only be known at runtime (a name, a url...): they are written as html::constant::hole, and their
+* number is part of the type (StaticHtml<Size, Holes>), so render() checks at compile time that it gets a value for
+* each hole. The positions of the holes are also computed while compiling, so render() just appends the static pieces
+* and the values (escaped if asked). The text is the same as the one of the equivalent html::Tag, except for a text
+* hole filled with "": the tags around it are already fixed, so P(hole) gives "<p>\n\n</p>\n" where html::P{""} gives
+* "<p/>\n". P("") is known while compiling, so it's "<p/>\n" like html::P{""}.
+*/
+namespace html::constant
+{
+  struct Hole {};
+  inline constexpr Hole hole{};
+
+  template <size_t Size, size_t Holes> struct StaticHtml
+  {
+    std::array<char, Size> chars{};       // the static text, with a '\0' where each hole goes
+    std::array<size_t, Holes> hole_at{};  // the position of each hole in chars
+
+    static constexpr size_t size = Size;
+    static constexpr size_t holes = Holes;
+
+    // Only for trees without holes: the whole text, stored in the program
+    constexpr std::string_view view() const
+    {
+      static_assert(Holes == 0, "the holes must be filled with render()");
+      return { chars.data(), Size };
+    }
+
+    template <typename... Values> void append_to(std::string& out, bool escape, const Values&... values) const
+    {
+      static_assert(sizeof...(Values) == Holes, "render() needs one value for each hole");
+      const std::string_view parts[] = { std::string_view(values)..., std::string_view() };
+      size_t start = 0;
+      for (size_t i = 0; i < Holes; ++i)
+      {
+        out.append(chars.data() + start, hole_at[i] - start);
+        if (escape)
+          append_escaped(out, parts[i].data(), parts[i].size());
+        else
+          out.append(parts[i].data(), parts[i].size());
+        start = hole_at[i] + 1;
+      }
+      out.append(chars.data() + start, Size - start);
+    }
+
+    template <typename... Values> std::string render(const Values&... values) const
+    {
+      std::string out;
+      out.reserve(Size + 64);
+      append_to(out, false, values...);
+      return out;
+    }
+  };
+
+  template <size_t S1, size_t H1, size_t S2, size_t H2>
+  constexpr StaticHtml<S1 + S2, H1 + H2> operator+(const StaticHtml<S1, H1>& a, const StaticHtml<S2, H2>& b)
+  {
+    StaticHtml<S1 + S2, H1 + H2> result;
+    for (size_t i = 0; i < S1; ++i)
+      result.chars[i] = a.chars[i];
+    for (size_t i = 0; i < S2; ++i)
+      result.chars[S1 + i] = b.chars[i];
+    for (size_t i = 0; i < H1; ++i)
+      result.hole_at[i] = a.hole_at[i];
+    for (size_t i = 0; i < H2; ++i)
+      result.hole_at[H1 + i] = S1 + b.hole_at[i];
+    return result;
+  }
+
+  // A string literal (without its final '\0')
+  template <size_t N> constexpr StaticHtml<N - 1, 0> text(const char (&literal)[N])
+  {
+    StaticHtml<N - 1, 0> result;
+    for (size_t i = 0; i + 1 < N; ++i)
+      result.chars[i] = literal[i];
+    return result;
+  }
+
+  constexpr StaticHtml<1, 1> text(Hole)
+  {
+    StaticHtml<1, 1> result;
+    result.chars[0] = '\0';
+    result.hole_at[0] = 0;
+    return result;
+  }
+
+  template <size_t N> constexpr auto P(const char (&paragraph_text)[N])
+  {
+    if constexpr (N == 1) // "", like html::Tag without text or children
+      return text("<p/>\n");
+    else
+      return text("<p>\n") + text(paragraph_text) + text("\n</p>\n");
+  }
+
+  constexpr auto P(Hole paragraph_text)
+  {
+    return text("<p>\n") + text(paragraph_text) + text("\n</p>\n");
+  }
+
+  template <size_t... Sizes, size_t... Holes> constexpr auto P(const StaticHtml<Sizes, Holes>&... children)
+  {
+    if constexpr (sizeof...(children) == 0)
+      return text("<p/>\n");
+    else
+      return (text("<p>\n") + ... + children) + text("</p>\n");
+  }
+
+  template <size_t N> constexpr auto IMG(const char (&url)[N])
+  {
+    return text("<img src=\"") + text(url) + text("\"/>\n");
+  }
+
+  constexpr auto IMG(Hole url)
+  {
+    return text("<img src=\"") + text(url) + text("\"/>\n");
+  }
+}
+
+// The same paragraph built and written at runtime, and rendered from the compile-time text
+void benchmark_constant_tags(size_t count)
+{
+  using namespace std::chrono;
+  constexpr auto gallery = html::constant::P(html::constant::IMG("http://pokemon.com/pikachu.png"),
+    html::constant::IMG(html::constant::hole));
+
+  size_t runtime_bytes = 0, constant_bytes = 0;
+  std::string runtime_text, constant_text;
+  auto start = steady_clock::now();
+  for (size_t i = 0; i < count; ++i)
+  {
+    const std::string url = "http://pokemon.com/" + std::to_string(i % 1000) + ".png";
+    runtime_text.clear();
+    html::P{ html::IMG{"http://pokemon.com/pikachu.png"}, html::IMG{url} }.write_to(runtime_text, false);
+    runtime_bytes += runtime_text.size();
+  }
+  const double runtime_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+
+  start = steady_clock::now();
+  for (size_t i = 0; i < count; ++i)
+  {
+    const std::string url = "http://pokemon.com/" + std::to_string(i % 1000) + ".png";
+    constant_text.clear();
+    gallery.append_to(constant_text, false, url);
+    constant_bytes += constant_text.size();
+  }
+  const double constant_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+
+  std::cout << count << " paragraphs: html::Tag " << runtime_ms << " ms, html::constant " << constant_ms << " ms"
+    << (runtime_text == constant_text && runtime_bytes == constant_bytes ? "" : " (MISMATCH!)") << std::endl;
 }
 
 int main1()
@@ -94,6 +298,19 @@ int main1()
 
     << std::endl;
 
+  std::cout << Escaped{ P{ IMG{"http://pokemon.com/search?name=pikachu&type=\"electric\""} } } << std::endl;
+
+  // the same tags, written while compiling
+  constexpr auto pikachu = constant::P(constant::IMG("http://pokemon.com/pikachu.png"));
+  static_assert(pikachu.view() == "<p>\n<img src=\"http://pokemon.com/pikachu.png\"/>\n</p>\n", "");
+  static_assert(constant::P("").view() == "<p/>\n", "");
+  std::cout << pikachu.view() << std::endl;
+
+  constexpr auto card = constant::P(constant::P(constant::hole), constant::IMG(constant::hole));
+  static_assert(decltype(card)::holes == 2, "");
+  std::cout << card.render("Raichu", "http://pokemon.com/raichu.png") << std::endl;
+  benchmark_constant_tags(1'000'000);
+
   getchar();
   return 0;
 }
\ No newline at end of file
@@ -3,12 +3,18 @@
 #include <vector>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <chrono>
 using namespace std;
 
 #include "Person.h"
 #include "PersonBuilder.h"
 #include "PersonAddressBuilder.h"
 #include "PersonJobBuilder.h"
+#include "PersonTable.h"
+#include "PersonTableBuilder.h"
+#include "PersonTableAddressBuilder.h"
+#include "PersonTableJobBuilder.h"
 
 /*
 * More complicated example of Builder pattern in which the object to build is very complex, so we need several builders to
@@ -33,6 +39,65 @@ using namespace std;
 * objects in total when creating the PersonBuilder, PersonAddressBuilder and PersonJobBuilder objects.
 */
 
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Person prints when it's created and destroyed, so the row by row version uses a struct with the same six fields
+struct PersonRecord
+{
+  string street_address, post_code, city;
+  string company_name, position;
+  int annual_income = 0;
+};
+
+void benchmark_person_table(size_t count)
+{
+  const string cities[] = { "London", "Madrid", "Paris", "Berlin", "Rome", "Lisbon", "Dublin", "Vienna" };
+  const string companies[] = { "PragmaSoft", "Initech", "Globex Corporation", "Umbrella Corporation" };
+  auto street = [](size_t i) { return to_string(i) + " Long Enough Street Name To Skip SSO"; };
+
+  vector<PersonRecord> records;
+  const double records_build_ms = measure_ms([&] {
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      records.push_back({ street(i), "SW1 1GB", cities[i % 8], companies[i % 4], "Consultant", static_cast<int>(i % 100000) });
+  });
+
+  PersonTable table;
+  const double table_build_ms = measure_ms([&] {
+    table.reserve(count, count * 48);
+    PersonTableBuilder builder{ table };
+    for (size_t i = 0; i < count; ++i)
+      builder.add()
+        .lives().at(street(i)).with_postcode("SW1 1GB").in(cities[i % 8])
+        .works().at(companies[i % 4]).as_a("Consultant").earning(static_cast<int>(i % 100000));
+  });
+
+  unordered_map<string, long long> records_income;
+  const double records_query_ms = measure_ms([&] {
+    for (auto& record : records)
+      records_income[record.city] += record.annual_income;
+  });
+  vector<long long> table_income;
+  const double table_query_ms = measure_ms([&] { table_income = table.income_by_city(); });
+
+  bool same = true;
+  for (PersonTable::Id city = 0; city < table.city_count(); ++city)
+  {
+    auto it = records_income.find(string(table.city_name(city)));
+    same = same && (it == records_income.end() ? table_income[city] == 0 : it->second == table_income[city]);
+  }
+
+  cout << count << " people\n"
+    << "  vector<PersonRecord>: build " << records_build_ms << " ms, income by city " << records_query_ms << " ms\n"
+    << "  PersonTable: build " << table_build_ms << " ms, income by city " << table_query_ms << " ms, "
+    << table.bytes() / (1024 * 1024) << " MB" << (same ? "" : " (MISMATCH!)") << "\n";
+}
+
 int main__()
 {
   Person p = Person::create()
@@ -46,6 +111,21 @@ int main__()
         .earning(10e6);
 
   cout << p << endl;
+
+  // the same facets, adding rows to a table
+  PersonTable table;
+  PersonTableBuilder builder{ table };
+  builder.add()
+    .lives().at("123 London Road").with_postcode("SW1 1GB").in("London")
+    .works().at("PragmaSoft").as_a("Consultant").earning(10e6);
+  builder.add()
+    .lives().at("1 Gran Via").in("Madrid")
+    .works().at("PragmaSoft").as_a("Developer").earning(60000);
+  auto income = table.income_by_city();
+  for (PersonTable::Id city = 1; city < table.city_count(); ++city)
+    cout << table.city_name(city) << ": " << income[city] << endl;
+
+  benchmark_person_table(1'000'000);
   getchar();
   return 0;
 }
\ No newline at end of file
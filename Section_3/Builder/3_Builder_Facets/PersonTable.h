@@ -0,0 +1,180 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <stdexcept>
+#include <limits>
+
+class PersonTableBuilderBase;
+class PersonTableAddressBuilder;
+class PersonTableJobBuilder;
+
+/*
+* Each Person has six strings of its own, so a million people are millions of small allocations spread all over
+* the memory, and adding the income of the people of a city means jumping from one Person to another.
+*
+* PersonTable stores the same data by columns (struct of arrays), one vector for each field:
+* - The strings of all the people are stored one after the other in a single buffer, and the columns only have
+*   the offset and length of each one (StringRef).
+* - Cities and companies repeat a lot, so each one is stored once and the columns city and company only have its id.
+* - annual_income is a vector<int>, so a query like income_by_city reads two dense columns (city ids and incomes)
+*   from the first row to the last one, without touching the other fields.
+*
+* The rows are added with PersonTableBuilder, which has the same facets (lives, works) as PersonBuilder.
+*/
+class PersonTable
+{
+public:
+  typedef uint32_t Id;
+
+  PersonTable()
+  {
+    // id 0 is the empty name, for the people whose city or company is not known
+    city_ids.intern("", chars);
+    company_ids.intern("", chars);
+  }
+
+  size_t size() const { return annual_incomes.size(); }
+
+  void reserve(size_t people, size_t bytes_of_text)
+  {
+    street_addresses.reserve(people);
+    post_codes.reserve(people);
+    positions.reserve(people);
+    cities.reserve(people);
+    companies.reserve(people);
+    annual_incomes.reserve(people);
+    chars.reserve(bytes_of_text);
+  }
+
+  std::string_view street_address(size_t row) const { return view(street_addresses[row]); }
+  std::string_view post_code(size_t row) const { return view(post_codes[row]); }
+  std::string_view city(size_t row) const { return city_name(cities[row]); }
+  std::string_view company_name(size_t row) const { return company(companies[row]); }
+  std::string_view position(size_t row) const { return view(positions[row]); }
+  int annual_income(size_t row) const { return annual_incomes[row]; }
+
+  size_t city_count() const { return city_ids.names.size(); }
+  size_t company_count() const { return company_ids.names.size(); }
+  std::string_view city_name(Id city) const { return view(city_ids.names[city]); }
+  std::string_view company(Id company) const { return view(company_ids.names[company]); }
+
+  // The columns, for queries which are not here
+  const std::vector<Id>& city_column() const { return cities; }
+  const std::vector<Id>& company_column() const { return companies; }
+  const std::vector<int>& annual_income_column() const { return annual_incomes; }
+
+  // Total income of the people of each city, indexed by city id
+  std::vector<long long> income_by_city() const
+  {
+    std::vector<long long> totals(city_count(), 0);
+    for (size_t row = 0; row < annual_incomes.size(); ++row)
+      totals[cities[row]] += annual_incomes[row];
+    return totals;
+  }
+
+  std::vector<double> average_income_by_city() const
+  {
+    std::vector<long long> totals(city_count(), 0);
+    std::vector<size_t> people(city_count(), 0);
+    for (size_t row = 0; row < annual_incomes.size(); ++row)
+    {
+      totals[cities[row]] += annual_incomes[row];
+      ++people[cities[row]];
+    }
+    std::vector<double> averages(city_count(), 0);
+    for (size_t city = 0; city < averages.size(); ++city)
+      if (people[city] > 0)
+        averages[city] = static_cast<double>(totals[city]) / people[city];
+    return averages;
+  }
+
+  // The memory used by the table, without the hash maps of the cities and companies
+  size_t bytes() const
+  {
+    return chars.capacity() + (street_addresses.capacity() + post_codes.capacity() + positions.capacity()) * sizeof(StringRef)
+      + (cities.capacity() + companies.capacity()) * sizeof(Id) + annual_incomes.capacity() * sizeof(int)
+      + (city_ids.names.capacity() + company_ids.names.capacity()) * sizeof(StringRef);
+  }
+
+private:
+  struct StringRef
+  {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  // Names stored once each, with a map from the text to the id
+  struct NameIds
+  {
+    std::vector<StringRef> names;
+    std::unordered_map<std::string, Id> ids;
+
+    Id intern(const std::string& name, std::string& chars)
+    {
+      auto it = ids.find(name);
+      if (it != ids.end())
+        return it->second;
+      const auto id = static_cast<Id>(names.size());
+      names.push_back(store(name, chars));
+      ids.emplace(name, id);
+      return id;
+    }
+  };
+
+  std::string chars;
+  std::vector<StringRef> street_addresses, post_codes, positions;
+  std::vector<Id> cities, companies;
+  std::vector<int> annual_incomes;
+  NameIds city_ids, company_ids;
+
+  static StringRef store(const std::string& value, std::string& chars)
+  {
+    if (chars.size() + value.size() > std::numeric_limits<uint32_t>::max())
+      throw std::length_error("PersonTable is limited to 4 GB of text");
+    StringRef ref;
+    ref.offset = static_cast<uint32_t>(chars.size());
+    ref.length = static_cast<uint32_t>(value.size());
+    chars += value;
+    return ref;
+  }
+
+  // Setting a field again writes over its old text when the new one fits, otherwise the new text is added at the end
+  // and the old one stays in chars, unused, until the table is destroyed
+  static void assign(StringRef& ref, const std::string& value, std::string& chars)
+  {
+    if (value.size() <= ref.length)
+    {
+      chars.replace(ref.offset, value.size(), value);
+      ref.length = static_cast<uint32_t>(value.size());
+    }
+    else
+      ref = store(value, chars);
+  }
+
+  std::string_view view(StringRef ref) const { return { chars.data() + ref.offset, ref.length }; }
+
+  size_t add_row()
+  {
+    street_addresses.emplace_back();
+    post_codes.emplace_back();
+    positions.emplace_back();
+    cities.push_back(0);
+    companies.push_back(0);
+    annual_incomes.push_back(0);
+    return annual_incomes.size() - 1;
+  }
+
+  void set_street_address(size_t row, const std::string& value) { assign(street_addresses[row], value, chars); }
+  void set_post_code(size_t row, const std::string& value) { assign(post_codes[row], value, chars); }
+  void set_city(size_t row, const std::string& value) { cities[row] = city_ids.intern(value, chars); }
+  void set_company_name(size_t row, const std::string& value) { companies[row] = company_ids.intern(value, chars); }
+  void set_position(size_t row, const std::string& value) { assign(positions[row], value, chars); }
+  void set_annual_income(size_t row, int value) { annual_incomes[row] = value; }
+
+  friend class PersonTableBuilderBase;
+  friend class PersonTableAddressBuilder;
+  friend class PersonTableJobBuilder;
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include "PersonTableBuilder.h"
+
+class PersonTableAddressBuilder : public PersonTableBuilderBase
+{
+  typedef PersonTableAddressBuilder Self;
+public:
+  PersonTableAddressBuilder(PersonTable& table, size_t row)
+  : PersonTableBuilderBase{ table, row }
+  {
+  }
+
+  Self& at(const std::string& street_address)
+  {
+    table.set_street_address(row, street_address);
+    return *this;
+  }
+
+  Self& with_postcode(const std::string& post_code)
+  {
+    table.set_post_code(row, post_code);
+    return *this;
+  }
+
+  Self& in(const std::string& city)
+  {
+    table.set_city(row, city);
+    return *this;
+  }
+};
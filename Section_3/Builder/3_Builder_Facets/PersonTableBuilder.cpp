@@ -0,0 +1,18 @@
+#include "PersonTableBuilder.h"
+#include "PersonTableAddressBuilder.h"
+#include "PersonTableJobBuilder.h"
+#include <stdexcept>
+
+PersonTableAddressBuilder PersonTableBuilderBase::lives() const
+{
+  if (row == no_row)
+    throw std::logic_error("PersonTableBuilder: call add() before lives()");
+  return PersonTableAddressBuilder{ table, row };
+}
+
+PersonTableJobBuilder PersonTableBuilderBase::works() const
+{
+  if (row == no_row)
+    throw std::logic_error("PersonTableBuilder: call add() before works()");
+  return PersonTableJobBuilder{ table, row };
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "PersonTable.h"
+
+class PersonTableAddressBuilder;
+class PersonTableJobBuilder;
+
+/*
+* The same facets as PersonBuilderBase, but instead of a Person they have a reference to a PersonTable and the row
+* they are filling, so the facets are small objects which can be copied freely.
+*
+* add() starts a new row, so a lot of people can be added one after the other with the same builder:
+*
+*   PersonTable table;
+*   PersonTableBuilder builder{ table };
+*   builder.add().lives().in("London").works().at("PragmaSoft").earning(100000);
+*   builder.add().lives().in("Madrid").works().at("PragmaSoft").earning(80000);
+*/
+class PersonTableBuilderBase
+{
+protected:
+  static constexpr size_t no_row = static_cast<size_t>(-1);
+
+  PersonTable& table;
+  size_t row;
+
+  PersonTableBuilderBase(PersonTable& table, size_t row)
+    : table{ table },
+      row{ row }
+  {
+  }
+
+public:
+  // builder facets, they throw logic_error before the first add()
+
+  PersonTableAddressBuilder lives() const;
+  PersonTableJobBuilder works() const;
+
+  // starts the next person
+  PersonTableBuilderBase add() const
+  {
+    return { table, table.add_row() };
+  }
+};
+
+class PersonTableBuilder : public PersonTableBuilderBase
+{
+public:
+  // Before the first add() there's no row to fill
+  explicit PersonTableBuilder(PersonTable& table)
+    : PersonTableBuilderBase{ table, no_row }
+  {
+  }
+};
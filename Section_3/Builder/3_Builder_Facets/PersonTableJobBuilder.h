@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include "PersonTableBuilder.h"
+
+class PersonTableJobBuilder : public PersonTableBuilderBase
+{
+  typedef PersonTableJobBuilder Self;
+public:
+  PersonTableJobBuilder(PersonTable& table, size_t row)
+  : PersonTableBuilderBase{ table, row }
+  {
+  }
+
+  Self& at(const std::string& company_name)
+  {
+    table.set_company_name(row, company_name);
+    return *this;
+  }
+
+  Self& as_a(const std::string& position)
+  {
+    table.set_position(row, position);
+    return *this;
+  }
+
+  Self& earning(int annual_income)
+  {
+    table.set_annual_income(row, annual_income);
+    return *this;
+  }
+};
@@ -3,6 +3,14 @@
 #include <string>
 #include <vector>
 #include <ostream>
+#include <fstream>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <exception>
+#include <system_error>
 using namespace std;
 
 namespace solution {
@@ -62,6 +70,189 @@ namespace solution {
     {
         return os << obj.the_class;
     }
+
+    /*
+    * Batch generation: CodeBuilder is fine for one class, but generating tens of thousands of classes with operator<<
+    * means a lot of small stream inserts and a copy of the type name in every field.
+    * - The type of each field is interned: "string" or "int" are stored once and the fields only keep their index.
+    * - The classes are split in one group per output file, and each group is rendered by its own thread.
+    * - Each thread appends the text to a string and writes it to its file in blocks of 1 MB.
+    * The text of each class is the same as the one written by operator<<.
+    */
+    struct GenerationStats
+    {
+        size_t classes = 0;
+        size_t bytes = 0;
+        double seconds = 0;
+
+        double classes_per_second() const { return seconds > 0 ? classes / seconds : 0; }
+        double bytes_per_second() const { return seconds > 0 ? bytes / seconds : 0; }
+    };
+
+    class BatchCodeGenerator
+    {
+        struct FieldSpec
+        {
+            string name;
+            uint32_t type;
+        };
+
+        struct ClassSpec
+        {
+            string name;
+            vector<FieldSpec> fields;
+        };
+
+        vector<ClassSpec> classes;
+        vector<string> type_names;
+        unordered_map<string, uint32_t> type_ids;
+
+        static constexpr size_t write_block = 1024 * 1024;
+
+    public:
+        // Fluent interface for the fields of the class which was added last
+        class ClassSpecBuilder
+        {
+            BatchCodeGenerator& generator;
+            size_t index;
+        public:
+            ClassSpecBuilder(BatchCodeGenerator& generator, size_t index) : generator{ generator }, index{ index } {}
+
+            ClassSpecBuilder& add_field(const string& name, const string& type)
+            {
+                generator.classes[index].fields.push_back({ name, generator.intern(type) });
+                return *this;
+            }
+        };
+
+        void reserve(size_t class_count) { classes.reserve(class_count); }
+
+        ClassSpecBuilder add_class(const string& class_name)
+        {
+            classes.push_back({ class_name, {} });
+            return { *this, classes.size() - 1 };
+        }
+
+        size_t size() const { return classes.size(); }
+        size_t type_count() const { return type_names.size(); }
+
+        // All the classes in one string, by the calling thread
+        void render(string& out) const
+        {
+            render(0, classes.size(), out);
+        }
+
+        // Writes prefix0.h, prefix1.h... with a contiguous group of classes in each one, a thread for each file.
+        // Throws runtime_error if a file can't be opened or written (the files already written are left as they are).
+        // The files whose thread can't be started are written by the calling thread.
+        GenerationStats write_files(const string& prefix, unsigned file_count = thread::hardware_concurrency()) const
+        {
+            const auto start = chrono::steady_clock::now();
+            if (file_count == 0)
+                file_count = 1;
+
+            vector<size_t> bytes(file_count);
+            vector<char> failed(file_count, false);
+            vector<exception_ptr> errors(file_count);
+            auto write_group_file = [&](unsigned file)
+            {
+                const size_t first = classes.size() * file / file_count;
+                const size_t last = classes.size() * (file + 1) / file_count;
+                ofstream output(prefix + to_string(file) + ".h", ios::binary);
+                string buffer;
+                buffer.reserve(write_block + 4096);
+                for (size_t i = first; i < last && output; ++i)
+                {
+                    render(i, i + 1, buffer);
+                    if (buffer.size() >= write_block)
+                    {
+                        output.write(buffer.data(), buffer.size());
+                        bytes[file] += buffer.size();
+                        buffer.clear();
+                    }
+                }
+                output.write(buffer.data(), buffer.size());
+                bytes[file] += buffer.size();
+                output.close();
+                failed[file] = output.fail();
+            };
+            auto write_group = [&](unsigned file)
+            {
+                try
+                {
+                    write_group_file(file);
+                }
+                catch (...)
+                {
+                    errors[file] = current_exception(); // an exception escaping a thread would end the program
+                }
+            };
+
+            vector<thread> workers;
+            workers.reserve(file_count);
+            unsigned started = 1;
+            try
+            {
+                for (; started < file_count; ++started)
+                    workers.emplace_back(write_group, started);
+            }
+            catch (const system_error&)
+            {
+                // no more threads available, the rest of the files are written below
+            }
+            write_group(0);
+            for (unsigned file = started; file < file_count; ++file)
+                write_group(file);
+            for (auto& worker : workers)
+                worker.join();
+            for (auto& error : errors)
+                if (error)
+                    rethrow_exception(error);
+
+            for (unsigned file = 0; file < file_count; ++file)
+                if (failed[file])
+                    throw runtime_error("can't write " + prefix + to_string(file) + ".h");
+
+            GenerationStats stats;
+            stats.classes = classes.size();
+            for (auto count : bytes)
+                stats.bytes += count;
+            stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            return stats;
+        }
+
+    private:
+        uint32_t intern(const string& type)
+        {
+            auto it = type_ids.find(type);
+            if (it != type_ids.end())
+                return it->second;
+            const auto id = static_cast<uint32_t>(type_names.size());
+            type_names.push_back(type);
+            type_ids.emplace(type, id);
+            return id;
+        }
+
+        void render(size_t first, size_t last, string& out) const
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const ClassSpec& spec = classes[i];
+                out += "class ";
+                out += spec.name;
+                out += "\n{\n";
+                for (const auto& field : spec.fields)
+                {
+                    out += "  ";
+                    out += type_names[field.type];
+                    out += ' ';
+                    out += field.name;
+                    out += ";\n";
+                }
+                out += "};\n";
+            }
+        }
+    };
 }
 
 #include "gtest/gtest.h"
@@ -74,6 +265,11 @@ namespace solution {
 #include <algorithm> 
 #include <cctype>
 #include <locale>
+#include <sstream>
+#include <cstdio>
+#include <iostream>
+#include <filesystem>
+#include <random>
 
 // trim from start (in place)
 static inline void ltrim(std::string &s) {
@@ -113,6 +309,24 @@ namespace
   {
   };
 
+  // A new directory in the temporary directory, removed with everything in it at the end of the test
+  struct TemporaryDirectory
+  {
+    std::filesystem::path path;
+
+    TemporaryDirectory()
+      : path{ std::filesystem::temp_directory_path() / ("builder_exercise_" + std::to_string(std::random_device{}())) }
+    {
+      std::filesystem::create_directories(path);
+    }
+
+    ~TemporaryDirectory()
+    {
+      std::error_code ignored;
+      std::filesystem::remove_all(path, ignored);
+    }
+  };
+
   TEST_F(Evaluate, EmptyTest)
   {
     solution::CodeBuilder cb{ "Foo" };
@@ -134,4 +348,71 @@ namespace
     trim(printed);
     ASSERT_EQ("class Person\n{\n  string name;\n  int age;\n};", printed);
   }
+
+  // Some schema-like classes, with the same few types repeated in all of them
+  void add_data_classes(solution::BatchCodeGenerator& generator, ostringstream& expected, size_t count)
+  {
+    const string types[] = { "int", "string", "double", "vector<string>", "bool" };
+    for (size_t i = 0; i < count; ++i)
+    {
+      const string name = "Record" + to_string(i);
+      auto spec = generator.add_class(name);
+      solution::CodeBuilder cb{ name };
+      for (size_t f = 0; f < i % 8; ++f)
+      {
+        spec.add_field("field" + to_string(f), types[(i + f) % 5]);
+        cb.add_field("field" + to_string(f), types[(i + f) % 5]);
+      }
+      expected << cb;
+    }
+  }
+
+  TEST_F(Evaluate, BatchRenderTest)
+  {
+    solution::BatchCodeGenerator generator;
+    ostringstream expected;
+    add_data_classes(generator, expected, 100);
+
+    string rendered;
+    generator.render(rendered);
+    ASSERT_EQ(expected.str(), rendered);
+    ASSERT_EQ(5u, generator.type_count());
+  }
+
+  TEST_F(Evaluate, BatchFilesTest)
+  {
+    solution::BatchCodeGenerator generator;
+    ostringstream expected;
+    const size_t count = 20000;
+    generator.reserve(count);
+    add_data_classes(generator, expected, count);
+
+    const unsigned files = 4;
+    TemporaryDirectory directory;
+    const string prefix = (directory.path / "generated_").string();
+    auto stats = generator.write_files(prefix, files);
+    cout << stats.classes << " classes, " << stats.bytes << " bytes in " << stats.seconds * 1000 << " ms: "
+      << stats.classes_per_second() << " classes/s, " << stats.bytes_per_second() / (1024 * 1024) << " MB/s" << endl;
+
+    string written;
+    for (unsigned file = 0; file < files; ++file)
+    {
+      ifstream input(prefix + to_string(file) + ".h", ios::binary);
+      written += string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    ASSERT_EQ(count, stats.classes);
+    ASSERT_EQ(expected.str().size(), stats.bytes);
+    ASSERT_EQ(expected.str(), written);
+  }
+
+  TEST_F(Evaluate, BatchFilesErrorTest)
+  {
+    solution::BatchCodeGenerator generator;
+    ostringstream expected;
+    add_data_classes(generator, expected, 10);
+
+    TemporaryDirectory directory;
+    const string prefix = (directory.path / "missing" / "generated_").string();
+    ASSERT_THROW(generator.write_files(prefix, 2), runtime_error) << "The directory of the files doesn't exist";
+  }
 } // namespace
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SINCOS_SSE2
+#include <emmintrin.h>
+#endif
+
+/*
+* sin and cos of many floats at once, for the batch functions of PointFactory.
+*
+* std::sin and std::cos are called one value at a time and have branches for the reduction of big arguments, so the
+* compiler can't do 4 of them at once. This is the classic Cephes sinf/cosf algorithm written without branches:
+* - The angle is reduced to [-pi/4, pi/4] by subtracting a multiple j of pi/2 in three steps (Cody-Waite), so the
+*   reduction doesn't lose the bits of the angle.
+* - Two short polynomials give the sin and the cos of the reduced angle, and the quadrant j decides (with masks, not
+*   ifs) which one is the sin and which one the cos, and their signs.
+* - Both come out of the same reduction, so computing the two costs little more than computing one.
+* With SSE2 (every x64 CPU) 4 angles are done at once with the same operations, without it one at a time
+* (sincos_scalar). Both give the same results unless the compiler contracts the scalar one into FMAs.
+*
+* Valid range: the fast path is used for |theta| <= fast_limit (8192), where the absolute error of sin and cos is below
+* 1.2e-7 (FLT_EPSILON, measured against the double std::sin/std::cos over the floats of that range: the worst one is
+* 9.3e-8). Bigger angles, infinities and NaNs go to std::sin/std::cos instead, one at a time: the reduction loses
+* precision there, and j wouldn't fit in the integer conversion.
+*/
+namespace sincos_detail
+{
+  constexpr float fast_limit = 8192.0f;
+  constexpr float four_over_pi = 1.27323954473516f;
+  // pi/4 in three parts, the first ones with few bits so j * part is exact
+  constexpr float pi_4_a = 0.78515625f;
+  constexpr float pi_4_b = 2.4187564849853515625e-4f;
+  constexpr float pi_4_c = 3.77489497744594108e-8f;
+
+  constexpr float sin_1 = -1.6666654611e-1f;
+  constexpr float sin_2 = 8.3321608736e-3f;
+  constexpr float sin_3 = -1.9515295891e-4f;
+  constexpr float cos_1 = 4.166664568298827e-2f;
+  constexpr float cos_2 = -1.388731625493765e-3f;
+  constexpr float cos_3 = 2.443315711809948e-5f;
+
+  inline uint32_t bits(float value)
+  {
+    uint32_t result;
+    std::memcpy(&result, &value, sizeof result);
+    return result;
+  }
+
+  inline float from_bits(uint32_t value)
+  {
+    float result;
+    std::memcpy(&result, &value, sizeof result);
+    return result;
+  }
+}
+
+inline void sincos_scalar(float theta, float& sin_theta, float& cos_theta)
+{
+  using namespace sincos_detail;
+  const uint32_t sign = bits(theta) & 0x80000000u;
+  float x = from_bits(bits(theta) & 0x7FFFFFFFu);
+  if (!(x <= fast_limit)) // also NaN
+  {
+    sin_theta = std::sin(theta);
+    cos_theta = std::cos(theta);
+    return;
+  }
+
+  // j is even: the multiple of pi/4 nearest to x, so x - j*pi/4 is in [-pi/4, pi/4]
+  const uint32_t j = (static_cast<uint32_t>(x * four_over_pi) + 1) & ~1u;
+  const float y = static_cast<float>(j);
+  x = ((x - y * pi_4_a) - y * pi_4_b) - y * pi_4_c;
+
+  const float z = x * x;
+  // In the same order as sincos_4, so both give the same bits
+  const float s = x + ((z * sin_3 + sin_2) * z + sin_1) * z * x;
+  const float c = (1.0f - z * 0.5f) + (z * z) * ((z * cos_3 + cos_2) * z + cos_1);
+
+  // In the quadrants 1 and 3 the polynomials swap roles
+  const uint32_t swap = 0u - ((j >> 1) & 1u);
+  const uint32_t sin_bits = (bits(s) & ~swap) | (bits(c) & swap);
+  const uint32_t cos_bits = (bits(c) & ~swap) | (bits(s) & swap);
+  sin_theta = from_bits(sin_bits ^ sign ^ ((j & 4u) << 29));
+  cos_theta = from_bits(cos_bits ^ ((~(j - 2) & 4u) << 29));
+}
+
+#ifdef SINCOS_SSE2
+// The same as sincos_scalar, for 4 angles
+inline void sincos_4(__m128 theta, __m128& sin_theta, __m128& cos_theta)
+{
+  using namespace sincos_detail;
+  const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+  const __m128 sign = _mm_and_ps(theta, sign_mask);
+  __m128 x = _mm_andnot_ps(sign_mask, theta);
+  // the lanes out of the fast range (or NaN) are computed as 0 here and replaced at the end
+  const __m128 outside = _mm_cmpnle_ps(x, _mm_set1_ps(fast_limit));
+  x = _mm_andnot_ps(outside, x);
+
+  __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(four_over_pi)));
+  j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+  const __m128 y = _mm_cvtepi32_ps(j);
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi_4_a)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi_4_b)));
+  x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi_4_c)));
+
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 s = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(sin_3)), _mm_set1_ps(sin_2));
+  s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(sin_1));
+  s = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(s, z), x));
+  __m128 c = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(cos_3)), _mm_set1_ps(cos_2));
+  c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(cos_1));
+  c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_mul_ps(_mm_mul_ps(z, z), c));
+
+  const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+  const __m128 sin_value = _mm_or_ps(_mm_andnot_ps(swap, s), _mm_and_ps(swap, c));
+  const __m128 cos_value = _mm_or_ps(_mm_andnot_ps(swap, c), _mm_and_ps(swap, s));
+  const __m128 sin_sign = _mm_xor_ps(sign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+  const __m128 cos_sign = _mm_castsi128_ps(
+    _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+  sin_theta = _mm_xor_ps(sin_value, sin_sign);
+  cos_theta = _mm_xor_ps(cos_value, cos_sign);
+
+  if (const int lanes = _mm_movemask_ps(outside))
+  {
+    alignas(16) float angles[4], sines[4], cosines[4];
+    _mm_store_ps(angles, theta);
+    _mm_store_ps(sines, sin_theta);
+    _mm_store_ps(cosines, cos_theta);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      if (lanes & (1 << lane))
+      {
+        sines[lane] = std::sin(angles[lane]);
+        cosines[lane] = std::cos(angles[lane]);
+      }
+    }
+    sin_theta = _mm_load_ps(sines);
+    cos_theta = _mm_load_ps(cosines);
+  }
+}
+#endif
+
+// Polar to cartesian for count points: x[i] = r[i]*cos(theta[i]), y[i] = r[i]*sin(theta[i])
+inline void polar_to_cartesian(const float* r, const float* theta, size_t count, float* x, float* y)
+{
+  size_t i = 0;
+#ifdef SINCOS_SSE2
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 sin_theta, cos_theta;
+    sincos_4(_mm_loadu_ps(theta + i), sin_theta, cos_theta);
+    const __m128 radius = _mm_loadu_ps(r + i);
+    _mm_storeu_ps(x + i, _mm_mul_ps(radius, cos_theta));
+    _mm_storeu_ps(y + i, _mm_mul_ps(radius, sin_theta));
+  }
+#endif
+  for (; i < count; ++i)
+  {
+    float sin_theta, cos_theta;
+    sincos_scalar(theta[i], sin_theta, cos_theta);
+    x[i] = r[i] * cos_theta;
+    y[i] = r[i] * sin_theta;
+  }
+}
@@ -4,8 +4,38 @@
 #include <map>
 #include "Creational.Creational.HotDrink.h"
 #include "Creational.Creational.DrinkFactory.h"
+#include "Creational.Creational.DrinkRegistry.h"
+#include <vector>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
 using namespace std;
 
+// Define COUNT_HEAP_ALLOCATIONS to replace the global operator new with one which counts the heap allocations of the
+// whole program, so benchmark_drink_values can show the ones it makes. Without it the allocator is the default one.
+#ifdef COUNT_HEAP_ALLOCATIONS
+static atomic<size_t> heap_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+  ++heap_allocations;
+  if (void* memory = malloc(size ? size : 1))
+    return memory;
+  throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+  free(memory);
+}
+#endif
+
 /*
 * Until now, all the previous sections are variations of the Factory Method pattern, now we're looking into the Abstract Factory pattern, which uses inheritance to 
 * build a family of factories.
@@ -46,6 +76,76 @@ unique_ptr<HotDrink> make_drink(string type)
   return drink;
 }
 
+template <typename F> double measure_ms(F&& f)
+{
+  const auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Finding the factory of a name (half of them unknown) in a map like the one of DrinkFactory and in DrinkRegistry
+void benchmark_drink_lookup(size_t count)
+{
+  map<string, unique_ptr<HotDrinkFactory>> hot_factories;
+  hot_factories["coffee"] = make_unique<CoffeeFactory>();
+  hot_factories["tea"] = make_unique<TeaFactory>();
+
+  const string names[] = { "tea", "coffee", "water", "chocolate", "te", "coffees", "mate", "juice" };
+  mt19937 rng{ 1 };
+  vector<const string*> requests(count);
+  for (auto& request : requests)
+    request = &names[rng() % 8];
+
+  size_t map_found = 0, registry_found = 0;
+  const double map_ms = measure_ms([&] {
+    for (auto request : requests)
+      map_found += hot_factories.find(*request) != hot_factories.end();
+  });
+  const double registry_ms = measure_ms([&] {
+    for (auto request : requests)
+      registry_found += DrinkRegistry::contains(*request);
+  });
+
+  cout << count << " lookups: map " << map_ms << " ms (" << count / map_ms / 1000 << " M lookups/s), DrinkRegistry "
+    << registry_ms << " ms (" << count / registry_ms / 1000 << " M lookups/s)"
+    << (map_found == registry_found ? "" : " (MISMATCH!)") << "\n";
+}
+
+// Making (and throwing away) drinks through the abstract factory, as unique_ptr and as DrinkValue
+void benchmark_drink_values(size_t count)
+{
+  const CoffeeFactory coffee;
+  const TeaFactory tea;
+  const HotDrinkFactory* factories[] = { &coffee, &tea };
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+  auto allocations_since = [](size_t start) { return " (" + to_string(heap_allocations - start) + " allocations)"; };
+  size_t allocations = heap_allocations;
+#else
+  auto allocations_since = [](size_t) { return string{}; };
+  size_t allocations = 0;
+#endif
+
+  size_t made = 0;
+  const double pointer_ms = measure_ms([&] {
+    for (size_t i = 0; i < count; ++i)
+      made += factories[i & 1]->make() != nullptr;
+  });
+  const string pointer_allocations = allocations_since(allocations);
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+  allocations = heap_allocations;
+#endif
+  const double value_ms = measure_ms([&] {
+    for (size_t i = 0; i < count; ++i)
+      made += static_cast<bool>(factories[i & 1]->make_value());
+  });
+  const string value_allocations = allocations_since(allocations);
+
+  cout << count << " drinks: unique_ptr " << pointer_ms << " ms" << pointer_allocations << ", DrinkValue "
+    << value_ms << " ms" << value_allocations << (made == 2 * count ? "" : " (MISMATCH!)") << "\n";
+}
+
 int main()
 {
   std::cout << "<<<<<<<<<<<<<<<<<<< Using a basic approach with ifs >>>>>>>>>>>>>>>>>>>>>>>\n\n";
@@ -59,6 +159,19 @@ int main()
   DrinkWithVolumeFactory dff;
   dff.make_drink("tea");
 
+  std::cout << "<<<<<<<<<<<<<<<<<<< Using a registry with a perfect hash computed at compile time >>>>>>>>>>>>>>>>>>>>>>>\n\n";
+  DrinkRegistry::make_drink("coffee", 50);
+  if (!DrinkRegistry::make_drink("water", 200) && !df.make_drink("water"))
+    std::cout << "There's no factory for water\n";
+  benchmark_drink_lookup(10'000'000);
+
+  std::cout << "<<<<<<<<<<<<<<<<<<< Drinks stored by value, without heap allocations >>>>>>>>>>>>>>>>>>>>>>>\n\n";
+  DrinkValue cup = TeaFactory{}.make_value();
+  DrinkValue another_cup = cup;
+  another_cup.prepare(300);
+  DrinkRegistry::make_value("coffee").prepare(100);
+  benchmark_drink_values(10'000'000);
+
   getchar();
   return 0;
 }
\ No newline at end of file
@@ -11,4 +11,9 @@ struct CoffeeFactory : HotDrinkFactory
   {
     return make_unique<Coffee>();
   }
+
+  DrinkValue make_value() const override
+  {
+    return DrinkValue::make<Coffee>();
+  }
 };
\ No newline at end of file
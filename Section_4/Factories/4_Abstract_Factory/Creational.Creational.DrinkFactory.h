@@ -18,9 +18,13 @@ public:
     hot_factories["tea"] = make_unique<TeaFactory>();
   }
 
+  // operator[] would insert an empty factory for an unknown name and then call it, so find is used instead
   unique_ptr<HotDrink> make_drink(const string& name)
   {
-    auto drink = hot_factories[name]->make();
+    auto it = hot_factories.find(name);
+    if (it == hot_factories.end())
+      return nullptr;
+    auto drink = it->second->make();
     drink->prepare(200); // oops!
     return drink;
   }
@@ -51,5 +55,6 @@ public:
 
 inline unique_ptr<HotDrink> DrinkWithVolumeFactory::make_drink(const string& name)
 {
-  return factories[name]();
+  auto it = factories.find(name);
+  return it == factories.end() ? nullptr : it->second();
 }
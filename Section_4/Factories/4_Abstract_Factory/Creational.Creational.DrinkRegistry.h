@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <iostream>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include "Creational.Creational.HotDrink.h"
+#include "Creational.Creational.DrinkValue.h"
+
+/*
+* DrinkFactory and DrinkWithVolumeFactory look up the name of the drink in a map<string, ...> every time: a few string
+* comparisons walking a tree. But the names of the drinks are known when the program is compiled, so the lookup table
+* can be computed by the compiler too.
+*
+* PerfectHash<N> is built with constexpr from the N names: it tries seeds for the hash function until every name falls
+* in a different slot of a table of at least 2N slots (a perfect hash, there are no collisions to resolve). Looking up
+* a name is one hash, one read of the table and one comparison with the name in that slot:
+* - No allocation (the name is a string_view) and no loop over the candidates.
+* - A name which is not a drink usually falls in an empty slot, or in a slot whose name has a different length,
+*   so it's discarded without comparing the characters (the fast miss path).
+*
+* DrinkRegistry uses it to find the function which makes each drink. An unknown name returns nullptr instead of
+* inserting an empty entry like map::operator[] does.
+*/
+template <size_t N> class PerfectHash
+{
+public:
+  static constexpr size_t table_size = [] { size_t size = 4; while (size < 2 * N) size *= 2; return size; }();
+
+  constexpr explicit PerfectHash(const std::array<std::string_view, N>& keys)
+    : keys{ keys }
+  {
+    for (uint32_t candidate = 1; candidate < (1u << 20); ++candidate)
+    {
+      if (try_seed(candidate))
+        return;
+    }
+    throw std::logic_error("no perfect hash found for these keys"); // a compile error when it's constexpr
+  }
+
+  // Index of the key in the array given to the constructor, or -1
+  constexpr int find(std::string_view key) const
+  {
+    const int index = slots[slot(key, seed)];
+    if (index < 0 || keys[index].size() != key.size())
+      return -1;
+    return keys[index] == key ? index : -1;
+  }
+
+  constexpr uint32_t hash_seed() const { return seed; }
+
+private:
+  std::array<std::string_view, N> keys;
+  std::array<int, table_size> slots{};
+  uint32_t seed = 0;
+
+  // FNV-1a, with the seed mixed into the initial value
+  static constexpr size_t slot(std::string_view key, uint32_t seed)
+  {
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : key)
+    {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (table_size - 1);
+  }
+
+  constexpr bool try_seed(uint32_t candidate)
+  {
+    for (auto& index : slots)
+      index = -1;
+    for (size_t i = 0; i < N; ++i)
+    {
+      auto& index = slots[slot(keys[i], candidate)];
+      if (index >= 0)
+        return false;
+      index = static_cast<int>(i);
+    }
+    seed = candidate;
+    return true;
+  }
+};
+
+class DrinkRegistry
+{
+  typedef std::unique_ptr<HotDrink> (*Maker)();
+
+  static constexpr std::array<std::string_view, 2> names{ { "coffee", "tea" } };
+  static constexpr PerfectHash<names.size()> lookup{ names };
+
+  static std::unique_ptr<HotDrink> make_coffee() { return std::make_unique<Coffee>(); }
+  static std::unique_ptr<HotDrink> make_tea() { return std::make_unique<Tea>(); }
+  static constexpr std::array<Maker, 2> makers{ { &make_coffee, &make_tea } }; // in the same order as names
+
+  typedef DrinkValue (*ValueMaker)();
+  static constexpr std::array<ValueMaker, 2> value_makers{ { &DrinkValue::make<Coffee>, &DrinkValue::make<Tea> } };
+
+public:
+  static constexpr bool contains(std::string_view name) { return lookup.find(name) >= 0; }
+
+  // nullptr if there's no drink with that name
+  static std::unique_ptr<HotDrink> make(std::string_view name)
+  {
+    const int index = lookup.find(name);
+    return index < 0 ? nullptr : makers[index]();
+  }
+
+  // An empty DrinkValue if there's no drink with that name
+  static DrinkValue make_value(std::string_view name)
+  {
+    const int index = lookup.find(name);
+    return index < 0 ? DrinkValue() : value_makers[index]();
+  }
+
+  static std::unique_ptr<HotDrink> make_drink(std::string_view name, int volume)
+  {
+    auto drink = make(name);
+    if (drink)
+      drink->prepare(volume);
+    return drink;
+  }
+};
+
+static_assert(DrinkRegistry::contains("tea") && DrinkRegistry::contains("coffee") && !DrinkRegistry::contains("water"),
+  "the drink names are resolved at compile time");
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "Creational.Creational.HotDrink.h"
+
+/*
+* A unique_ptr<HotDrink> means a heap allocation (and a free) for each drink, even if Tea and Coffee are tiny objects.
+*
+* DrinkValue holds the drink itself inside a small buffer of its own, so it can be returned by value from a factory
+* without touching the heap:
+* - The drink is constructed in the buffer with placement new, so only types which fit in it can be stored
+*   (checked at compile time).
+* - Instead of using the vtable of HotDrink through a pointer, DrinkValue keeps a pointer to a small table of
+*   functions (prepare, copy, move, destroy) generated for each drink type, so it can also copy and move the drink
+*   without knowing its type (type erasure).
+* A DrinkValue can be empty (like a null unique_ptr), for example when a factory doesn't know the drink.
+*/
+class DrinkValue
+{
+public:
+  static constexpr size_t capacity = 32;
+
+  DrinkValue() = default;
+
+  template <typename Drink, typename... Args> static DrinkValue make(Args&&... args)
+  {
+    static_assert(std::is_base_of<HotDrink, Drink>::value, "DrinkValue only stores hot drinks");
+    static_assert(sizeof(Drink) <= capacity && alignof(Drink) <= alignof(std::max_align_t), "the drink doesn't fit in DrinkValue");
+    static_assert(std::is_nothrow_move_constructible<Drink>::value, "moving a DrinkValue must not throw");
+    DrinkValue value;
+    new (value.storage) Drink(std::forward<Args>(args)...);
+    value.ops = &ops_for<Drink>;
+    return value;
+  }
+
+  DrinkValue(const DrinkValue& other)
+  {
+    if (other.ops)
+    {
+      other.ops->copy(storage, other.storage);
+      ops = other.ops;
+    }
+  }
+
+  DrinkValue(DrinkValue&& other) noexcept
+  {
+    if (other.ops)
+    {
+      other.ops->move(storage, other.storage);
+      ops = other.ops;
+      other.reset();
+    }
+  }
+
+  DrinkValue& operator=(DrinkValue other) noexcept
+  {
+    reset();
+    if (other.ops)
+    {
+      other.ops->move(storage, other.storage);
+      ops = other.ops;
+      other.reset();
+    }
+    return *this;
+  }
+
+  ~DrinkValue()
+  {
+    reset();
+  }
+
+  explicit operator bool() const { return ops != nullptr; }
+
+  void prepare(int volume)
+  {
+    if (!ops)
+      throw std::logic_error("DrinkValue::prepare on an empty drink");
+    ops->prepare(storage, volume);
+  }
+
+  void reset()
+  {
+    if (ops)
+    {
+      ops->destroy(storage);
+      ops = nullptr;
+    }
+  }
+
+private:
+  struct Ops
+  {
+    void (*prepare)(void* drink, int volume);
+    void (*copy)(void* to, const void* from);
+    void (*move)(void* to, void* from);
+    void (*destroy)(void* drink);
+  };
+
+  template <typename Drink> static constexpr Ops ops_for
+  {
+    [](void* drink, int volume) { static_cast<Drink*>(drink)->Drink::prepare(volume); }, // Drink:: skips the virtual call
+    [](void* to, const void* from) { new (to) Drink(*static_cast<const Drink*>(from)); },
+    [](void* to, void* from) { new (to) Drink(std::move(*static_cast<Drink*>(from))); },
+    [](void* drink) { static_cast<Drink*>(drink)->~Drink(); }
+  };
+
+  alignas(std::max_align_t) unsigned char storage[capacity];
+  const Ops* ops = nullptr;
+};
@@ -1,7 +1,12 @@
 #pragma once
 #include "Creational.Creational.HotDrink.h"
+#include "Creational.Creational.DrinkValue.h"
 
 struct HotDrinkFactory
 {
   virtual unique_ptr<HotDrink> make() const = 0;
+
+  // The same drink stored by value, without a heap allocation (see DrinkValue.h). The factories which don't
+  // override it return an empty DrinkValue.
+  virtual DrinkValue make_value() const { return {}; }
 };
\ No newline at end of file
@@ -6,4 +6,8 @@ struct TeaFactory : HotDrinkFactory
   unique_ptr<HotDrink> make() const override {
     return make_unique<Tea>();
   }
+
+  DrinkValue make_value() const override {
+    return DrinkValue::make<Tea>();
+  }
 };
\ No newline at end of file